@@ -0,0 +1,41 @@
+// Startup time-to-warm: a fresh process runs SCRIPTS distinct ~100KB contracts once each, as after a deploy. Measured
+// without the on-disk store, with an empty store (everything compiles and is written) and with the store the previous
+// process left behind (everything is mapped from disk). Every row is a fresh process, so the in-memory cache starts empty.
+const fs = require("fs")
+const os = require("os")
+const path = require("path")
+const Glomium = require("..")
+const { nowNs, elapsedMs, isolated, printResult, makeBundle } = require("./common")
+
+const SCRIPTS = Number(process.env.SCRIPTS || 50)
+const SCRIPT_BYTES = Number(process.env.SCRIPT_BYTES || 100 * 1024)
+
+async function measure(name, directory) {
+    Glomium.configurePool({ scriptCache: { maxBytes: 256 * 1024 * 1024, directory } })
+    const base = makeBundle(SCRIPT_BYTES)
+    const scripts = Array.from({ length: SCRIPTS }, (_, i) => `${base}\nlib.contract = ${i};`)
+    const start = nowNs()
+    const vm = new Glomium({ gas: { limit: 1e9 } })
+    for (const script of scripts) {
+        await vm.run(script)
+    }
+    const ms = elapsedMs(start)
+    await vm.dispose()
+    const { diskHits, diskWrites } = Glomium.getStats().scriptCache
+    return { store: name, scripts: SCRIPTS, timeToWarmMs: +ms.toFixed(1), diskHits, diskWrites }
+}
+
+if (process.argv[2]) {
+    measure(process.argv[2], process.argv[3] || "").then(printResult)
+} else {
+    const directory = fs.mkdtempSync(path.join(os.tmpdir(), "glomium-store-"))
+    try {
+        console.table([
+            isolated(__filename, ["none"]),
+            isolated(__filename, ["empty", directory]),
+            isolated(__filename, ["populated", directory])
+        ])
+    } finally {
+        fs.rmSync(directory, { recursive: true, force: true })
+    }
+}
@@ -0,0 +1,55 @@
+// Helpers shared by the benchmark scripts. Every script runs on its own against the built addon: `node bench/<name>.js`.
+const { execFileSync } = require("child_process")
+
+function nowNs() {
+    return process.hrtime.bigint()
+}
+
+function elapsedMs(startNs) {
+    return Number(process.hrtime.bigint() - startNs) / 1e6
+}
+
+function percentile(samples, p) {
+    const sorted = [...samples].sort((a, b) => a - b)
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]
+}
+
+function wait(ms) {
+    return new Promise(res => setTimeout(res, ms))
+}
+
+// Runs script again in a fresh process, for measurements that must not share heaps, caches or the pool.
+// The child prints its result as JSON on its last line.
+function isolated(script, args = [], env = {}) {
+    const output = execFileSync(process.execPath, ["--expose-gc", script, ...args], { encoding: "utf8", env: { ...process.env, ...env } })
+    return JSON.parse(output.trim().split("\n").pop())
+}
+
+function printResult(result) {
+    console.log(JSON.stringify(result))
+}
+
+// Synthetic library of about `bytes` source bytes: many small functions hung off one global object, roughly the shape of a
+// bundled npm library. Calling `lib.entry()` touches the last of them.
+function makeBundle(bytes) {
+    const parts = ["var lib = {};"]
+    let size = parts[0].length
+    let count = 0
+    while (size < bytes) {
+        const part = `lib.f${count} = function (a, b) { var r = []; for (var i = 0; i < a; i++) { r.push({ k: "v" + i, n: i * ${count} + b }) } return r.length };\n`
+        parts.push(part)
+        size += part.length
+        count++
+    }
+    parts.push(`lib.entry = function () { return lib.f${count - 1}(3, 1) };`)
+    return parts.join("")
+}
+
+async function settleMemory() {
+    for (let i = 0; i < 3; i++) {
+        global.gc?.()
+        await wait(50)
+    }
+}
+
+module.exports = { nowNs, elapsedMs, percentile, wait, isolated, printResult, makeBundle, settleMemory }
@@ -0,0 +1,42 @@
+// Create/dispose soak: CYCLES instances are created, run one call and are released, CONCURRENCY at a time. Resident memory
+// and active libuv handles are sampled every SAMPLE cycles and should stay flat. With MODE=gc instances are dropped without
+// dispose(), so the garbage collector's finalizer has to release them.
+const Glomium = require("..")
+const { nowNs, elapsedMs, printResult, settleMemory } = require("./common")
+
+const CYCLES = Number(process.env.CYCLES || 1e6)
+const CONCURRENCY = Number(process.env.CONCURRENCY || 64)
+const SAMPLE = Number(process.env.SAMPLE || 50000)
+const MODE = process.env.MODE || "dispose"
+
+function activeHandles() {
+    return process.getActiveResourcesInfo ? process.getActiveResourcesInfo().length : 0
+}
+
+async function cycle() {
+    const vm = new Glomium()
+    await vm.run("1 + 1")
+    if (MODE === "dispose") {
+        await vm.dispose()
+    }
+}
+
+async function main() {
+    const start = nowNs()
+    const samples = []
+    for (let done = 0; done < CYCLES;) {
+        const batch = Math.min(CONCURRENCY, CYCLES - done)
+        await Promise.all(Array.from({ length: batch }, cycle))
+        done += batch
+        if (done % SAMPLE < batch || done === CYCLES) {
+            await settleMemory()
+            samples.push({ cycles: done, rssMb: +(process.memoryUsage().rss / 1048576).toFixed(1), handles: activeHandles() })
+            console.log(JSON.stringify(samples[samples.length - 1]))
+        }
+    }
+    const first = samples[0]
+    const last = samples[samples.length - 1]
+    printResult({ mode: MODE, cycles: CYCLES, seconds: +(elapsedMs(start) / 1000).toFixed(1), rssGrowthMb: +(last.rssMb - first.rssMb).toFixed(1), handleGrowth: last.handles - first.handles })
+}
+
+main()
@@ -0,0 +1,84 @@
+// Cross-socket penalty. Every row is a fresh process running one instance per CPU of NUMA node 0, each walking a state
+// object built once in its heap, so calls are bound by memory access:
+// - default, pin and numa compare the pool's placement options
+// - local and remote use numactl to run the process on node 0 with its memory bound to node 0 or to node 1, the
+//   difference between the two is the cost of a remote heap. They need numactl and at least two nodes.
+const fs = require("fs")
+const os = require("os")
+const { execFileSync } = require("child_process")
+const Glomium = require("..")
+const { nowNs, elapsedMs, percentile, isolated, printResult } = require("./common")
+
+const CALLS = Number(process.env.CALLS || 200)
+const STATE_ITEMS = Number(process.env.STATE_ITEMS || 200000)
+const MODES = {
+    default: {},
+    pin: { pin: true },
+    numa: { numa: true },
+    local: {},
+    remote: {}
+}
+const NUMACTL = {
+    local: ["--cpunodebind=0", "--membind=0"],
+    remote: ["--cpunodebind=0", "--membind=1"]
+}
+
+function nodeCpus(node) {
+    try {
+        const list = fs.readFileSync(`/sys/devices/system/node/node${node}/cpulist`, "utf8").trim()
+        return list.split(",").reduce((count, range) => {
+            const [first, last = first] = range.split("-").map(Number)
+            return count + last - first + 1
+        }, 0)
+    } catch {
+        return 0
+    }
+}
+
+const INSTANCES = Number(process.env.INSTANCES || nodeCpus(0) || os.cpus().length)
+
+async function measure(name) {
+    Glomium.configurePool({ placement: MODES[name] })
+    const instances = []
+    for (let i = 0; i < INSTANCES; i++) {
+        const vm = new Glomium({ gas: { limit: 1e9 } })
+        await vm.run(`var state = []; for (var i = 0; i < ${STATE_ITEMS}; i++) state.push({ i: i })`)
+        instances.push(vm)
+    }
+    const samples = []
+    await Promise.all(instances.map(async vm => {
+        for (let i = 0; i < CALLS; i++) {
+            const start = nowNs()
+            await vm.run("var s = 0; for (var j = 0; j < state.length; j++) s += state[j].i; s")
+            samples.push(elapsedMs(start))
+        }
+    }))
+    await Promise.all(instances.map(vm => vm.dispose()))
+    return { placement: name, instances: INSTANCES, calls: samples.length, p50Ms: +percentile(samples, 0.5).toFixed(3), p99Ms: +percentile(samples, 0.99).toFixed(3) }
+}
+
+function numactl(name) {
+    const output = execFileSync("numactl", [...NUMACTL[name], process.execPath, "--expose-gc", __filename, name], { encoding: "utf8" })
+    return JSON.parse(output.trim().split("\n").pop())
+}
+
+function hasNumactl() {
+    try {
+        execFileSync("numactl", ["--show"], { stdio: "ignore" })
+        return true
+    } catch {
+        return false
+    }
+}
+
+if (process.argv[2]) {
+    measure(process.argv[2]).then(printResult)
+} else {
+    const rows = ["default", "pin", "numa"].map(name => isolated(__filename, [name]))
+    if (nodeCpus(1) > 0 && hasNumactl()) {
+        rows.push(numactl("local"), numactl("remote"))
+    } else {
+        console.log("local/remote rows skipped: they need numactl and a second NUMA node")
+    }
+    console.table(rows)
+}
@@ -0,0 +1,54 @@
+// Creation time and heap bytes for each global profile, each profile in a fresh process.
+// - Creation time: new instance until its first call returned, one instance at a time.
+// - Heap bytes: resident memory grown by REALMS realms of one instance, divided by REALMS. Realms have no thread of their
+//   own, so this counts the heap (a full set of builtins plus the profile's global) without thread stacks.
+const Glomium = require("..")
+const { nowNs, elapsedMs, percentile, isolated, printResult, settleMemory } = require("./common")
+
+const COUNT = Number(process.env.COUNT || 200)
+const REALMS = Number(process.env.REALMS || 1000)
+const PROFILES = {
+    full: "full",
+    bare: "bare",
+    restricted: ["JSON", "Math", "Object", "Array", "String", "Number", "parseInt"]
+}
+
+async function creationTimes(profile) {
+    const samples = []
+    for (let i = 0; i < COUNT; i++) {
+        const start = nowNs()
+        const vm = new Glomium({ profile })
+        await vm.run("0")
+        samples.push(elapsedMs(start))
+        await vm.dispose()
+    }
+    return samples
+}
+
+async function heapBytesPerRealm(profile) {
+    const vm = new Glomium({ profile })
+    await vm.run("0")
+    await settleMemory()
+    const before = process.memoryUsage().rss
+    const realms = []
+    for (let i = 0; i < REALMS; i++) {
+        realms.push(await vm.createRealm())
+    }
+    await Promise.all(realms.map(realm => realm.run("0")))
+    await settleMemory()
+    const bytes = (process.memoryUsage().rss - before) / REALMS
+    await vm.dispose()
+    return bytes
+}
+
+async function measure(name) {
+    const samples = await creationTimes(PROFILES[name])
+    const bytes = await heapBytesPerRealm(PROFILES[name])
+    return { profile: name, createP50Ms: +percentile(samples, 0.5).toFixed(3), createP99Ms: +percentile(samples, 0.99).toFixed(3), heapKb: +(bytes / 1024).toFixed(1) }
+}
+
+if (process.argv[2]) {
+    measure(process.argv[2]).then(printResult)
+} else {
+    console.table(Object.keys(PROFILES).map(name => isolated(__filename, [name])))
+}
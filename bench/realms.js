@@ -0,0 +1,32 @@
+// Heap bytes per realm, with own builtins (default) and with sharedBuiltins. Each mode is measured in a fresh process:
+// resident memory grown by creating COUNT realms in one instance (each has run one call), divided by COUNT.
+const Glomium = require("..")
+const { isolated, printResult, settleMemory } = require("./common")
+
+const COUNT = Number(process.env.COUNT || 1000)
+const MODES = {
+    own: false,
+    shared: true
+}
+
+async function measure(name) {
+    const instance = new Glomium({ sharedBuiltins: MODES[name] })
+    await instance.run("0")
+    await settleMemory()
+    const before = process.memoryUsage().rss
+    const realms = []
+    for (let i = 0; i < COUNT; i++) {
+        realms.push(await instance.createRealm())
+    }
+    await Promise.all(realms.map(realm => realm.run("0")))
+    await settleMemory()
+    const bytesPerRealm = (process.memoryUsage().rss - before) / COUNT
+    instance.dispose()
+    return { builtins: name, realms: COUNT, kbPerRealm: +(bytesPerRealm / 1024).toFixed(1) }
+}
+
+if (process.argv[2]) {
+    measure(process.argv[2]).then(printResult)
+} else {
+    console.table(Object.keys(MODES).map(name => isolated(__filename, [name])))
+}
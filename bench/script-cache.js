@@ -0,0 +1,32 @@
+// run() latency of a ~200KB bundle with the compiled script cache off (every run parses and compiles) and warm (the cache
+// was primed with one run, later runs load bytecode). Each mode is measured in a fresh process.
+const Glomium = require("..")
+const { nowNs, elapsedMs, percentile, isolated, printResult, makeBundle } = require("./common")
+
+const RUNS = Number(process.env.RUNS || 200)
+const BUNDLE = makeBundle(Number(process.env.BUNDLE_BYTES || 200 * 1024))
+const MODES = {
+    cold: 0,
+    warm: 64 * 1024 * 1024
+}
+
+async function measure(name) {
+    Glomium.configurePool({ scriptCache: { maxBytes: MODES[name] } })
+    const vm = new Glomium({ gas: { limit: 1e9 } })
+    await vm.run(BUNDLE)
+    const samples = []
+    for (let i = 0; i < RUNS; i++) {
+        const start = nowNs()
+        await vm.run(BUNDLE)
+        samples.push(elapsedMs(start))
+    }
+    await vm.dispose()
+    const { hits, misses } = Glomium.getStats().scriptCache
+    return { cache: name, bundleKb: Math.round(BUNDLE.length / 1024), p50Ms: +percentile(samples, 0.5).toFixed(3), p99Ms: +percentile(samples, 0.99).toFixed(3), hitRate: hits + misses ? +(hits / (hits + misses)).toFixed(3) : 0 }
+}
+
+if (process.argv[2]) {
+    measure(process.argv[2]).then(printResult)
+} else {
+    console.table(Object.keys(MODES).map(name => isolated(__filename, [name])))
+}
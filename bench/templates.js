@@ -0,0 +1,45 @@
+// Time to first eval of a new instance that needs a library and a few globals: set() and run() on a plain instance versus
+// an instance created from a template that already holds them. Each path is measured in a fresh process.
+const Glomium = require("..")
+const { nowNs, elapsedMs, percentile, isolated, printResult, makeBundle } = require("./common")
+
+const COUNT = Number(process.env.COUNT || 200)
+const BUNDLE = makeBundle(Number(process.env.BUNDLE_BYTES || 300 * 1024))
+const CONFIG = { gas: { limit: 1e9 } }
+const SETTINGS = { region: "eu", limits: { requests: 100, burst: 10 } }
+
+const PATHS = {
+    async plain() {
+        const vm = new Glomium(CONFIG)
+        await vm.set("settings", SETTINGS)
+        await vm.run(BUNDLE)
+        await vm.run("lib.entry()")
+        return vm
+    },
+    async template(template) {
+        const vm = new Glomium({ ...CONFIG, template })
+        await vm.run("lib.entry()")
+        return vm
+    }
+}
+
+async function measure(name) {
+    const template = name === "template" && await Glomium.createTemplate(CONFIG, async t => {
+        await t.set("settings", SETTINGS)
+        await t.run(BUNDLE)
+    })
+    const samples = []
+    for (let i = 0; i < COUNT; i++) {
+        const start = nowNs()
+        const vm = await PATHS[name](template)
+        samples.push(elapsedMs(start))
+        await vm.dispose()
+    }
+    return { path: name, instances: COUNT, bundleKb: Math.round(BUNDLE.length / 1024), p50Ms: +percentile(samples, 0.5).toFixed(3), p99Ms: +percentile(samples, 0.99).toFixed(3) }
+}
+
+if (process.argv[2]) {
+    measure(process.argv[2]).then(printResult)
+} else {
+    console.table(Object.keys(PATHS).map(name => isolated(__filename, [name])))
+}
@@ -0,0 +1,49 @@
+// Call throughput with the Node side spread over 1, 2, 4... worker_threads. Every thread has its own instances, so result
+// conversion and promise settlement run on as many event loops as there are threads. Calls return a mid-sized object to
+// give the Node side real work. Throughput should grow with the thread count until the cores run out.
+const { Worker, isMainThread, parentPort, workerData } = require("worker_threads")
+const os = require("os")
+const { nowNs, elapsedMs } = require("./common")
+
+const INSTANCES = Number(process.env.INSTANCES || 4)
+const DURATION_MS = Number(process.env.DURATION_MS || 3000)
+const MAX_THREADS = Number(process.env.MAX_THREADS || os.cpus().length)
+const RESULT = "(function () { var r = []; for (var i = 0; i < 200; i++) r.push({ id: i, name: 'item' + i, tags: ['a', 'b'] }); return r })()"
+
+async function runThread() {
+    const Glomium = require("..")
+    const instances = Array.from({ length: INSTANCES }, () => new Glomium({ gas: { limit: 1e9 } }))
+    const start = nowNs()
+    let calls = 0
+    await Promise.all(instances.map(async vm => {
+        while (elapsedMs(start) < DURATION_MS) {
+            await vm.run(RESULT)
+            calls++
+        }
+    }))
+    await Promise.all(instances.map(vm => vm.dispose()))
+    parentPort.postMessage(calls)
+}
+
+function runThreads(count) {
+    return Promise.all(Array.from({ length: count }, () => new Promise((resolve, reject) => {
+        const worker = new Worker(__filename, { workerData: true })
+        worker.once("message", resolve)
+        worker.once("error", reject)
+    })))
+}
+
+async function main() {
+    const rows = []
+    for (let threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        const calls = (await runThreads(threads)).reduce((a, b) => a + b, 0)
+        rows.push({ threads, instances: threads * INSTANCES, callsPerSec: Math.round(calls / (DURATION_MS / 1000)) })
+    }
+    console.table(rows)
+}
+
+if (isMainThread) {
+    main()
+} else if (workerData) {
+    runThread()
+}
@@ -1,11 +1,74 @@
 {
+  "variables": {
+    "glomium_preludes%": ["<!@(node -p \"require('fs').readdirSync('preludes').filter(f => f.endsWith('.js')).sort().map(f => 'preludes/' + f).join(' ')\")"]
+  },
   "targets": [
+    {
+      "target_name": "prelude_compiler",
+      "type": "executable",
+      "sources": [
+        "./fatal_handler.c",
+        "./duktape/src-new/duktape.c",
+        "./prelude_compiler.cpp"
+      ],
+      "include_dirs": [
+        "./duktape/src-new",
+        "./"
+      ],
+      "conditions": [
+        ["OS=='linux'", {
+          "libraries": ["-lm"]
+        }]
+      ]
+    },
     {
       "target_name": "duktape_bindings",
+      "dependencies": ["prelude_compiler"],
+      "actions": [
+        {
+          "action_name": "embed_preludes",
+          "inputs": [
+            "<(PRODUCT_DIR)/prelude_compiler<(EXECUTABLE_SUFFIX)",
+            "<@(glomium_preludes)"
+          ],
+          "outputs": ["<(INTERMEDIATE_DIR)/embedded_preludes.cpp"],
+          "action": ["<(PRODUCT_DIR)/prelude_compiler<(EXECUTABLE_SUFFIX)", "<@(_outputs)", "<@(glomium_preludes)"],
+          "process_outputs_as_sources": 1
+        },
+        {
+          "action_name": "duktape_build_id",
+          "inputs": [
+            "./scripts/build_id.js",
+            "./duktape/src-new/duktape.c",
+            "./duktape/src-new/duktape.h",
+            "./duktape/src-new/duk_config.h"
+          ],
+          "outputs": ["<(INTERMEDIATE_DIR)/duktape_build_id.cpp"],
+          "action": ["node", "./scripts/build_id.js", "<@(_outputs)", "./duktape/src-new/duktape.c", "./duktape/src-new/duktape.h", "./duktape/src-new/duk_config.h"],
+          "process_outputs_as_sources": 1
+        }
+      ],
       "sources": [
         "./fatal_handler.c",
         "./duktape/src-new/duktape.c",
         "./conversion_utils.cpp",
+        "./napi_encoder.cpp",
+        "./scheduler.cpp",
+        "./native_plugins.cpp",
+        "./placement.cpp",
+        "./script_cache.cpp",
+        "./bytecode_store.cpp",
+        "./heap_pool.cpp",
+        "./descriptors.cpp",
+        "./intrinsics.cpp",
+        "./checkpoint.cpp",
+        "./journal.cpp",
+        "./realms.cpp",
+        "./handles.cpp",
+        "./host_functions.cpp",
+        "./completion_channel.cpp",
+        "./profile.cpp",
+        "./preludes.cpp",
         "bindings.cpp"
       ],
       "include_dirs": [
@@ -23,6 +86,9 @@
       "defines": [ 'NAPI_DISABLE_CPP_EXCEPTIONS' ],
       "cflags_cc":[],
       "conditions": [
+        ["OS=='linux'", {
+          "libraries": ["-ldl"]
+        }],
         ["OS=='win'", {
           "cflags!": ["/EHs", "/EHc"],
           "cflags_cc": ["/EHsc"],
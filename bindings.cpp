@@ -8,221 +8,917 @@
 #include <functional>
 #include <iostream>
 #include "conversion_utils.h"
+#include "scheduler.h"
+#include "native_plugins.h"
+#include "placement.h"
+#include "script_cache.h"
+#include "heap_pool.h"
+#include "checkpoint.h"
+#include "journal.h"
+#include "realms.h"
+#include "completion_channel.h"
+#include "profile.h"
+#include "preludes.h"
+#include "handles.h"
+#include "host_functions.h"
+#include "intrinsics.h"
+#include "napi_encoder.h"
 #include <assert.h>
 #include "json.hpp"
 #include <chrono>
 #include <mutex>
 #include <thread>
+#include <future>
 #include <queue>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+#include <map>
 #include <setjmp.h>
+#include <cstring>
 
 using json = nlohmann::json;
-std::mutex EventCallbacksMapMutex;
-std::unordered_map<duk_context *, Napi::ThreadSafeFunction> eventCallbacks;
-std::unordered_map<duk_context *, std::unordered_map<int, FunctionContext>> contextFunctionMap;
-std::unordered_map<duk_context *, int> contextFunctionCounters;
 
-struct ThreadData
+struct IdleStats
 {
-    std::thread thread;
-    std::queue<std::string> messageQueue;
+    std::atomic<uint64_t> spinWakeups{0};
+    std::atomic<uint64_t> yieldWakeups{0};
+    std::atomic<uint64_t> parkWakeups{0};
+    std::atomic<uint64_t> spinLatencyNs{0};
+    std::atomic<uint64_t> yieldLatencyNs{0};
+    std::atomic<uint64_t> parkLatencyNs{0};
+    std::atomic<uint64_t> maxLatencyNs{0};
+    std::atomic<int64_t> idleGapEwmaNs{0};
+};
+
+struct ResultStats
+{
+    std::atomic<uint64_t> converted{0};
+    std::atomic<uint64_t> discarded{0};
+    std::atomic<uint64_t> picked{0};
+    std::atomic<uint64_t> handles{0};
+    std::atomic<uint64_t> conversionNs{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+struct GlomiumContext
+{
+    std::queue<json> messageQueue; // encoded by napi_to_json on the main thread
     std::mutex queueMutex;
     std::condition_variable cv;
     bool stopThread = false;
+    NapiFunctionExecutionData *pendingRequest = nullptr; // host call the engine thread waits for, failed by stop_context
+    bool parked = false; // only a parked worker needs notify_one, a spinning one polls pendingMessages
+    std::atomic<size_t> pendingMessages{0};
+    std::atomic<int64_t> lastEnqueueNs{0};
+    IdlePolicy idlePolicy;
+    IdleStats idleStats;
+    ResultStats resultStats;
+    bool localHeap = false; // NUMA placement, heaps are created by this thread instead of taken from the pool
+    GlobalProfile profile; // applied to every heap and realm of the context
+    std::vector<const EmbeddedPrelude *> preludes; // installed before the profile, so a profile can keep what they define
+    bool sharedBuiltins = false; // builtins are frozen and realms share them instead of getting a copy
+    std::unordered_map<uint32_t, GasData> realmGas; // gas of every realm, swapped into the heap while the realm runs
+
+    PooledHeap heap; // owned by the engine thread, empty after a fatal error until the next flush
+    napi_env env; // the env that created the context, the only one allowed to use it
+    std::shared_ptr<CompletionChannel> channel; // the env's
+    napi_ref handler = nullptr; // weak, made strong by every call still waiting for its result
+    bool disposed = false; // env thread only
+    jmp_buf fatalState; // fatal_handler jumps back here, a heap only ever runs on its context's thread
 };
 
-std::unordered_map<duk_context *, std::shared_ptr<ThreadData>> contextThreadMap;
-
-std::mutex contextThreadMapMutex;
+// Instance data of every env that loaded the addon
+struct AddonEnv
+{
+    std::shared_ptr<CompletionChannel> channel;
+    std::unordered_set<GlomiumContext *> contexts; // until their closing item is delivered
+};
 
-jmp_buf pre_fatal_state;
+// Item of the completion channel, completesCall pairs it with the call_thread that took a handler ref.
+// The engine thread's last item hands over its reference to the context, so the context outlives all its events.
+struct ContextEvent
+{
+    GlomiumContext *context;
+    std::string message;
+    bool completesCall;
+    std::shared_ptr<GlomiumContext> closed;
+};
 
-void emit_event_callback(duk_context *ctx, const std::string &message);
+void emit_event_callback(duk_context *ctx, const std::string &message, bool completesCall = true);
+void emit_to_node(GlomiumContext *context, const std::string &message, bool completesCall = true);
 
-void cleanup_thread_for_context(duk_context *ctx)
+void complete_node_request(NapiFunctionExecutionData *request, json response, bool errored)
 {
-    std::shared_ptr<ThreadData> *threadDataPtr = nullptr;
+    std::lock_guard<std::mutex> lock(request->mtx);
+    request->response = std::move(response);
+    request->ready = true;
+    request->errored = errored;
+    request->cv.notify_one();
+}
 
+// Stops the engine thread without waiting for it. A host call it waits for is failed here, nothing else would answer
+// it once the env is gone. The engine thread fails whatever is still queued, destroys its heap and posts its closing
+// item on its own.
+void stop_context(GlomiumContext *context)
+{
+    if (context->disposed)
+    {
+        return;
+    }
+    context->disposed = true;
     {
-        std::lock_guard<std::mutex> lock(contextThreadMapMutex);
-        auto it = contextThreadMap.find(ctx);
-        if (it == contextThreadMap.end())
+        std::lock_guard<std::mutex> lock(context->queueMutex);
+        context->stopThread = true;
+        if (context->pendingRequest)
         {
-            return;
+            complete_node_request(context->pendingRequest, "Context was disposed", true);
+            context->pendingRequest = nullptr;
         }
-        threadDataPtr = &(it->second);
     }
+    context->cv.notify_one();
+}
 
-    if (!threadDataPtr || !(*threadDataPtr))
+bool track_node_request(duk_context *ctx, NapiFunctionExecutionData *request)
+{
+    GlomiumContext *context = heap_owner(ctx);
+    std::lock_guard<std::mutex> lock(context->queueMutex);
+    if (context->stopThread)
     {
-        return;
+        return false;
     }
+    context->pendingRequest = request;
+    return true;
+}
 
-    ThreadData *threadData = threadDataPtr->get();
+void untrack_node_request(duk_context *ctx)
+{
+    GlomiumContext *context = heap_owner(ctx);
+    std::lock_guard<std::mutex> lock(context->queueMutex);
+    context->pendingRequest = nullptr;
+}
 
+void finalize_context(napi_env env, void *finalize_data, void *finalize_hint)
+{
+    auto *context = static_cast<std::shared_ptr<GlomiumContext> *>(finalize_data);
+    stop_context(context->get());
+    delete context;
+}
+
+// Throws and returns nullptr unless external is a context created by this env
+GlomiumContext *get_context(napi_env env, napi_value external)
+{
+    std::shared_ptr<GlomiumContext> *context = nullptr;
+    if (napi_get_value_external(env, external, (void **)&context) != napi_ok || !context)
     {
-        std::lock_guard<std::mutex> lock(threadData->queueMutex);
-        threadData->stopThread = true;
+        napi_throw_type_error(env, nullptr, "Expected a context");
+        return nullptr;
+    }
+    if ((*context)->env != env)
+    {
+        napi_throw_error(env, nullptr, "Context belongs to another environment");
+        return nullptr;
+    }
+    return context->get();
+}
+
+AddonEnv *get_addon_env(napi_env env)
+{
+    AddonEnv *addonEnv = nullptr;
+    napi_get_instance_data(env, (void **)&addonEnv);
+    return addonEnv;
+}
+
+// Env teardown (worker_thread exit or process exit): its contexts can't deliver anywhere anymore
+void cleanup_addon_env(void *data)
+{
+    AddonEnv *addonEnv = static_cast<AddonEnv *>(data);
+    for (GlomiumContext *context : addonEnv->contexts)
+    {
+        stop_context(context);
+    }
+    addonEnv->contexts.clear();
+    addonEnv->channel->close();
+}
+
+void finalize_addon_env(napi_env env, void *data, void *hint)
+{
+    delete static_cast<AddonEnv *>(data);
+}
+
+void deliver_context_event(napi_env env, void *item)
+{
+    ContextEvent *event = static_cast<ContextEvent *>(item);
+    napi_ref handlerRef = event->context->handler;
+    if (!env)
+    {
+        // Channel closed with the env, nothing left to notify
+    }
+    else if (event->closed)
+    {
+        napi_delete_reference(env, handlerRef);
+        event->context->handler = nullptr;
+        get_addon_env(env)->contexts.erase(event->context);
+    }
+    else if (env && handlerRef)
+    {
+        napi_value handler = nullptr;
+        napi_get_reference_value(env, handlerRef, &handler);
+        if (event->completesCall)
+        {
+            napi_reference_unref(env, handlerRef, nullptr);
+            event->context->channel->drop();
+        }
+        if (handler)
+        {
+            Napi::Function(env, handler).Call({Napi::String::New(env, event->message)});
+        }
+    }
+    delete event;
+}
+
+void fatal_handler(void *udata, const char *msg)
+{
+
+    HeapConfig *heapData = (HeapConfig *)udata;
+    GlomiumContext *context = static_cast<HeapGasData *>(heapData->gasConfig)->owner;
+    if (!context)
+    {
+        abort(); // warmup of a pooled heap, nothing to unwind to (prepare_heap binds the owner before any setup)
     }
-    threadData->cv.notify_one();
 
-    if (threadData->thread.joinable())
+    longjmp(context->fatalState, 1);
+};
+
+// Error stack if there is one, otherwise the thrown value as string. Leaves the stack as it was.
+std::string error_to_string(duk_context *ctx, duk_idx_t idx)
+{
+    idx = duk_normalize_index(ctx, idx);
+    if (duk_is_error(ctx, idx))
+    {
+        duk_get_prop_string(ctx, idx, "stack");
+    }
+    else
     {
-        threadData->thread.join();
+        duk_dup(ctx, idx);
     }
+    std::string error = duk_safe_to_string(ctx, -1);
+    duk_pop(ctx);
+    return error;
+}
 
+// callFinished for a call whose error is on the stack top. A transactional call is rolled back first, if it was stopped
+// at its gas limit it reports out of gas with the gas info, like a fatal out of gas but with the heap kept.
+json failed_call_message(duk_context *ctx, const json &msg, bool transaction)
+{
+    json finished{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", error_to_string(ctx, -1)}};
+    if (!transaction)
+    {
+        return finished;
+    }
+    bool outOfGas = transaction_out_of_gas(ctx);
+    bool rolledBack = rollback_transaction(ctx); // puts the call's own gas limit back
+    if (outOfGas)
     {
-        std::lock_guard<std::mutex> lock(contextThreadMapMutex);
-        contextThreadMap.erase(ctx);
+        GasData *gasData = duk_get_gas_info(ctx);
+        finished["error"] = "Out of gas";
+        finished["gasInfo"] = {{"gasLimit", gasData->gas_limit}, {"gasUsed", gasData->gas_used}, {"memCostPerByte", gasData->mem_cost_per_byte}};
     }
+    if (!rolledBack)
+    {
+        finished["error"] = finished["error"].get<std::string>() + " (transaction rollback incomplete)";
+    }
+    return finished;
 }
 
-void cleanup_context(napi_env env, void *finalize_data, void *finalize_hint)
+bool message_flag(const json &msg, const char *name)
 {
-    duk_context *ctx = static_cast<duk_context *>(finalize_data);
+    auto it = msg.find(name);
+    return it != msg.end() && it->is_boolean() && it->get<bool>();
+}
+
+int64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Slot for a picked path in the projection, nullptr if an earlier path already took a parent of it as a whole
+json *pick_slot(json &picked, const json &path)
+{
+    json *slot = &picked;
+    for (const auto &key : path)
     {
-        std::lock_guard<std::mutex> lock(EventCallbacksMapMutex);
-        auto it = eventCallbacks.find(ctx);
-        if (it != eventCallbacks.end())
+        if (!slot->is_object() && !slot->is_null())
         {
-            it->second.Release();
-            eventCallbacks.erase(it);
-            cleanup_thread_for_context(ctx);
-            duk_destroy_heap(ctx);
+            return nullptr;
         }
-        else
+        slot = &(*slot)[key.is_string() ? key.get<std::string>() : key.dump()];
+    }
+    return slot;
+}
+
+// Completion value at idx as the call's "result" option asks for it: converted as a whole by default, not at all
+// for "discard", only the listed paths for {pick: [...]}, and objects pinned behind a handle for "handle"
+json call_result(duk_context *ctx, duk_idx_t idx, const json &msg, ResultStats &stats)
+{
+    auto it = msg.find("result");
+    if (it == msg.end())
+    {
+        stats.converted++;
+        return duk_to_json(ctx, idx);
+    }
+    if (*it == "discard")
+    {
+        stats.discarded++;
+        return nullptr;
+    }
+    if (*it == "handle" && duk_is_object(ctx, idx) && !duk_is_function(ctx, idx))
+    {
+        stats.handles++;
+        return json{{"__engineInternalProperties", {{"type", "objectHandle"}, {"handle", pin_handle(ctx, idx)}}}};
+    }
+    if (it->is_object() && it->contains("pick"))
+    {
+        stats.picked++;
+        idx = duk_normalize_index(ctx, idx);
+        json picked = json::object();
+        for (const auto &path : (*it)["pick"])
         {
-            // std::cout << "Node's GC trying to clean flushed context, already cleaned.";
+            // Paths that can't be read are left out, same as a missing property
+            if (push_path(ctx, idx, path) && !duk_is_undefined(ctx, -1))
+            {
+                json *slot = pick_slot(picked, path);
+                if (slot)
+                {
+                    *slot = duk_to_json(ctx, -1);
+                }
+            }
+            duk_pop(ctx);
         }
+        return picked;
     }
-    auto itcf = contextFunctionMap.find(ctx);
-    if (itcf != contextFunctionMap.end())
+    stats.converted++;
+    return duk_to_json(ctx, idx);
+}
+
+// callFinished with the completion value at idx. Calls asking for "stats" also get how long the call ran before its
+// result was converted, how long the conversion took and how large the result message is.
+void finish_call(duk_context *ctx, duk_idx_t idx, const json &msg, int64_t startNs)
+{
+    ResultStats &stats = heap_owner(ctx)->resultStats;
+    int64_t convertStartNs = steady_now_ns();
+    json result = call_result(ctx, idx, msg, stats);
+    int64_t conversionNs = steady_now_ns() - convertStartNs;
+    std::string message = json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", std::move(result)}}.dump();
+    stats.conversionNs += conversionNs;
+    stats.bytes += message.size();
+    if (message_flag(msg, "stats"))
     {
-        contextFunctionMap.erase(itcf);
+        size_t bytes = message.size();
+        message.pop_back(); // closing brace, the stats go in after the result
+        message += ",\"stats\":" + json{{"executionNs", convertStartNs - startNs}, {"conversionNs", conversionNs}, {"resultBytes", bytes}}.dump() + "}";
     }
+    emit_event_callback(ctx, message);
 }
 
-void call_event_callback(Napi::Env env, Napi::Function jsCallback, std::string *data)
+void count_host_values(const json &value, std::map<uint32_t, uint64_t> &uses)
 {
-    jsCallback.Call({Napi::String::New(env, *data)});
-    delete data;
+    if (value.is_array())
+    {
+        for (const auto &item : value)
+        {
+            count_host_values(item, uses);
+        }
+    }
+    else if (value.is_object())
+    {
+        auto internalProps = value.find("__engineInternalProperties");
+        if (internalProps == value.end())
+        {
+            for (const auto &item : value)
+            {
+                count_host_values(item, uses);
+            }
+        }
+        else if (internalProps->is_object() && internalProps->contains("id") &&
+                 (internalProps->value("type", "") == "function" || internalProps->value("type", "") == "hostObject"))
+        {
+            uses[(*internalProps)["id"].get<uint32_t>()]++;
+        }
+    }
 }
 
-void fatal_handler(void *udata, const char *msg)
+// Node counts every host value it sends. Values of a message the engine never converted are reported back as used
+// and dropped, the same way the finalizer of a wrapper reports them, so Node doesn't hold them forever.
+void release_unsent_host_values(GlomiumContext *threadData, const json &value)
 {
+    std::map<uint32_t, uint64_t> uses;
+    count_host_values(value, uses);
+    for (const auto &entry : uses)
+    {
+        emit_to_node(threadData, json{{"event", "hostValueReleased"}, {"id", entry.first}, {"uses", entry.second}}.dump(), false);
+    }
+}
 
-    HeapConfig *heapData = (HeapConfig *)udata;
-    duk_context *ctx = (duk_context *)heapData->ctx;
+// Fails a message the engine didn't run at all
+void reject_message(GlomiumContext *threadData, const json &msg, const char *error)
+{
+    release_unsent_host_values(threadData, msg);
+    emit_to_node(threadData, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", error}}.dump());
+}
 
-    longjmp(pre_fatal_state, 1);
-};
+void record_wakeup(GlomiumContext *threadData, std::atomic<uint64_t> &wakeups, std::atomic<uint64_t> &latencyTotal, int64_t idleStartNs)
+{
+    IdleStats &stats = threadData->idleStats;
+    int64_t now = steady_now_ns();
+    uint64_t latency = (uint64_t)std::max<int64_t>(0, now - threadData->lastEnqueueNs.load(std::memory_order_relaxed));
+    wakeups++;
+    latencyTotal += latency;
+    if (latency > stats.maxLatencyNs.load(std::memory_order_relaxed))
+    {
+        stats.maxLatencyNs = latency;
+    }
+    int64_t gap = now - idleStartNs;
+    int64_t ewma = stats.idleGapEwmaNs.load(std::memory_order_relaxed);
+    stats.idleGapEwmaNs = ewma == 0 ? gap : (ewma * 7 + gap) / 8;
+}
 
-duk_context *create_bare_context(GasData *gasData)
+// Spin, then yield, then park. Called and returns with queueMutex held.
+void wait_for_messages(GlomiumContext *threadData, std::unique_lock<std::mutex> &lock)
 {
+    if (!threadData->messageQueue.empty() || threadData->stopThread)
+    {
+        return;
+    }
+    const IdlePolicy &policy = threadData->idlePolicy;
+    IdleStats &stats = threadData->idleStats;
+    int64_t idleStartNs = steady_now_ns();
+    int64_t spinNs = (int64_t)policy.spinUs * 1000;
+    int64_t budgetNs = spinNs + (int64_t)policy.yieldUs * 1000;
 
-    auto *initGasData = new GasData;
-    initGasData->gas_limit = 999999; // just a big enough value for Duktape to warm up
-    initGasData->gas_used = 0;
-    initGasData->mem_cost_per_byte = 0;
+    if (budgetNs > 0 && (!policy.adaptive || stats.idleGapEwmaNs.load(std::memory_order_relaxed) <= budgetNs))
+    {
+        lock.unlock();
+        int64_t idleNs = 0;
+        while (threadData->pendingMessages.load(std::memory_order_acquire) == 0 && idleNs < budgetNs)
+        {
+            if (idleNs >= spinNs)
+            {
+                std::this_thread::yield();
+            }
+            idleNs = steady_now_ns() - idleStartNs;
+        }
+        lock.lock();
+        if (!threadData->messageQueue.empty())
+        {
+            if (idleNs < spinNs)
+            {
+                record_wakeup(threadData, stats.spinWakeups, stats.spinLatencyNs, idleStartNs);
+            }
+            else
+            {
+                record_wakeup(threadData, stats.yieldWakeups, stats.yieldLatencyNs, idleStartNs);
+            }
+            return;
+        }
+    }
 
-    auto *heapConfig = new HeapConfig;
-    heapConfig->gasConfig = initGasData;
+    threadData->parked = true;
+    threadData->cv.wait(lock, [threadData]()
+                        { return !threadData->messageQueue.empty() || threadData->stopThread; });
+    threadData->parked = false;
+    if (!threadData->messageQueue.empty())
+    {
+        record_wakeup(threadData, stats.parkWakeups, stats.parkLatencyNs, idleStartNs);
+    }
+}
 
-    duk_context *ctx = duk_create_heap(duk_gas_respecting_alloc_function, duk_gas_respecting_realloc_function, duk_gas_respecting_free_function, heapConfig, (duk_fatal_function)fatal_handler);
-    heapConfig->ctx = (void *)ctx;
-    heapConfig->gasConfig = gasData;
-    // duk_push_bare_object(ctx); // Uncomment to remove such unneccessary globals like "Object", "Array", "Number", "String", etc
-    // duk_set_global_object(ctx);
-    return ctx;
+// Preludes first, a restricted profile then picks from everything they defined. Intrinsics are captured before either.
+// With shared builtins they are frozen once preludes are in, and the globals realms start from are recorded.
+bool prepare_globals(duk_context *ctx, const GlomiumContext *context)
+{
+    capture_intrinsics(ctx);
+    if (!install_preludes(ctx, context->preludes))
+    {
+        return false;
+    }
+    if (context->sharedBuiltins && !(record_realm_globals(ctx) && lock_down_intrinsics(ctx)))
+    {
+        return false;
+    }
+    return apply_global_profile(ctx, context->profile);
 }
 
-void create_and_associate_thread(duk_context *ctx)
+// Fresh heap for the context, bound to it before its globals are prepared so that a fatal error during setup (out of
+// memory, an internal error) unwinds here instead of aborting the process. Releases the heap if setup failed.
+bool prepare_heap(const PooledHeap &heap, GlomiumContext *context, uint32_t gasLimit, uint32_t memCostPerByte)
 {
-    auto threadData = std::make_shared<ThreadData>();
-    std::thread workerThread([ctx, threadData]() mutable {
+    jmp_buf outerState; // flushContext prepares a heap while a message is being handled
+    memcpy(outerState, context->fatalState, sizeof(jmp_buf));
+    heap.gasData->owner = context;
+    volatile bool prepared = false;
+    if (setjmp(context->fatalState) == 0)
+    {
+        prepared = prepare_globals(heap.ctx, context);
+    }
+    memcpy(context->fatalState, outerState, sizeof(jmp_buf));
+    if (!prepared)
+    {
+        release_heap(heap);
+        return false;
+    }
+    rebind_heap_gas(heap, context, gasLimit, memCostPerByte);
+    return true;
+}
+
+// Heap is created on the engine thread itself, after placement is applied, so its memory is first-touched on the thread's NUMA node
+bool start_context_thread(const std::shared_ptr<GlomiumContext> &context, uint32_t gasLimit, uint32_t memCostPerByte, const ContextPlacement &placement)
+{
+    context->localHeap = placement.localHeap;
+    std::promise<bool> heapCreated;
+    std::future<bool> created = heapCreated.get_future();
+    std::thread workerThread([gasLimit, memCostPerByte, context, placement, heapCreated = std::move(heapCreated)]() mutable {
+        GlomiumContext *threadData = context.get();
+        apply_context_placement(placement);
+        // A pooled heap was first-touched on the pool thread, so NUMA placement always builds its own
+        threadData->heap = threadData->localHeap ? create_heap() : acquire_heap();
+        duk_context *ctx = threadData->heap.ctx;
+        if (ctx && !prepare_heap(threadData->heap, threadData, gasLimit, memCostPerByte))
+        {
+            threadData->heap = PooledHeap();
+            ctx = nullptr;
+        }
+        heapCreated.set_value(ctx != nullptr);
+        if (!ctx)
+        {
+            return;
+        }
 
-        
         std::unique_lock<std::mutex> lock(threadData->queueMutex);
         while (!threadData->stopThread) {
-            threadData->cv.wait(lock, [threadData](){ return !threadData->messageQueue.empty() || threadData->stopThread; });
+            wait_for_messages(threadData, lock);
 
-            while (!threadData->messageQueue.empty()) {
-                std::string message = threadData->messageQueue.front();
+            while (!threadData->messageQueue.empty() && !threadData->stopThread) {
+                json msg = std::move(threadData->messageQueue.front());
                 threadData->messageQueue.pop();
-                auto msg = json::parse(message, nullptr, false);
-                
+                threadData->pendingMessages--;
+                lock.unlock(); // let Node keep queueing while guest code runs
+
+                acquire_execution_slot();
+
                 auto eventName = msg["event"].get<std::string>();
-                if (setjmp(pre_fatal_state)==0){// Handling fatal errors, primarily used for out of gas, other fatal errors shouldn't occur in normal circumstances 
-                    if (eventName == "setGlobal")
+                if (!ctx && eventName != "flushContext")
+                {
+                    reject_message(threadData, msg, "Context was stopped by a fatal error, clear() it to continue");
+                    release_execution_slot();
+                    lock.lock();
+                    continue;
+                }
+
+                // Realm messages run on the realm's thread with the realm's gas swapped into the shared heap
+                duk_context *const heapCtx = ctx;
+                GasData *heapGas = nullptr;
+                GasData savedGas;
+                auto realmGas = threadData->realmGas.end();
+                if (msg.contains("realm"))
+                {
+                    realmGas = threadData->realmGas.find(msg["realm"].get<uint32_t>());
+                    duk_context *realmCtx = realmGas == threadData->realmGas.end() ? nullptr : get_realm_context(heapCtx, realmGas->first);
+                    if (!realmCtx)
                     {
-                        auto globalValue = msg["globalValue"].dump();
+                        reject_message(threadData, msg, "Realm is no longer available");
+                        release_execution_slot();
+                        lock.lock();
+                        continue;
+                    }
+                    heapGas = duk_get_gas_info(heapCtx);
+                    savedGas = *heapGas;
+                    *heapGas = realmGas->second;
+                    ctx = realmCtx;
+                }
 
-                        json_to_duk(ctx, globalValue);
+                // Per-call gas budget on top of what was used so far, never above the context's own limit
+                GasData *budgetGas = nullptr;
+                uint64_t budgetLimit = 0;
+                if (msg.contains("gasBudget"))
+                {
+                    budgetGas = duk_get_gas_info(ctx);
+                    budgetLimit = budgetGas->gas_limit;
+                    budgetGas->gas_limit = std::min<uint64_t>(budgetLimit, budgetGas->gas_used + msg["gasBudget"].get<uint64_t>());
+                }
+
+                int64_t callStartNs = steady_now_ns();
+                if (setjmp(threadData->fatalState)==0){// Handling fatal errors, primarily used for out of gas, other fatal errors shouldn't occur in normal circumstances 
+                    if (eventName == "setGlobal")
+                    {
+                        json_to_duk(ctx, msg["globalValue"]);
                         duk_put_global_string(ctx, msg["globalName"].get<std::string>().c_str());
                         emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", true}}.dump());
                     }
                     else if (eventName == "eval")
                     {
                         std::string code = msg["code"].get<std::string>();
-                        if (duk_peval_string(ctx, code.c_str()) != 0)
+                        bool transaction = message_flag(msg, "transaction");
+                        if (transaction)
+                        {
+                            begin_transaction(ctx);
+                        }
+                        bool evaluated = push_cached_script(ctx, code);
+                        if (evaluated)
+                        {
+                            duk_push_global_object(ctx);
+                            evaluated = duk_pcall_method(ctx, 0) == 0;
+                        }
+                        if (!evaluated)
+                        {
+                            emit_event_callback(ctx, failed_call_message(ctx, msg, transaction).dump());
+                        }
+                        else
+                        {
+                            if (transaction)
+                            {
+                                commit_transaction(ctx);
+                            }
+                            finish_call(ctx, -1, msg, callStartNs);
+                        }
+                        duk_pop(ctx);
+                    }
+                    else if (eventName == "callHandle")
+                    {
+                        if (!push_handle(ctx, msg["handle"].get<uint64_t>()))
+                        {
+                            release_unsent_host_values(threadData, msg["args"]);
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"error", "Function is no longer available"}}.dump());
+                        }
+                        else
+                        {
+                            bool transaction = message_flag(msg, "transaction");
+                            if (transaction)
+                            {
+                                begin_transaction(ctx);
+                            }
+                            for (const auto &arg : msg["args"])
+                            {
+                                json_to_duk(ctx, arg);
+                            }
+                            if (duk_pcall(ctx, msg["args"].size()) != 0)
+                            {
+                                emit_event_callback(ctx, failed_call_message(ctx, msg, transaction).dump());
+                            }
+                            else
+                            {
+                                if (transaction)
+                                {
+                                    commit_transaction(ctx);
+                                }
+                                finish_call(ctx, -1, msg, callStartNs);
+                            }
+                            duk_pop(ctx);
+                        }
+                    }
+                    else if (eventName == "prepareScript")
+                    {
+                        bool prepared = push_cached_script(ctx, msg["code"].get<std::string>());
+                        if (prepared)
+                        {
+                            duk_push_global_object(ctx);
+                            prepared = duk_pcall_method(ctx, 0) == 0;
+                        }
+                        if (!prepared)
+                        {
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", error_to_string(ctx, -1)}}.dump());
+                        }
+                        else if (!duk_is_function(ctx, -1))
                         {
-                            if (duk_is_error(ctx, -1))
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", "Compiled code has to evaluate to a function"}}.dump());
+                        }
+                        else
+                        {
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", pin_handle(ctx, -1)}}.dump());
+                        }
+                        duk_pop(ctx);
+                    }
+                    else if (eventName == "handleGet")
+                    {
+                        if (!push_handle_path(ctx, msg["handle"].get<uint64_t>(), msg["path"]))
+                        {
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"error", error_to_string(ctx, -1)}}.dump());
+                        }
+                        else
+                        {
+                            finish_call(ctx, -1, msg, callStartNs);
+                        }
+                        duk_pop(ctx);
+                    }
+                    else if (eventName == "handleKeys")
+                    {
+                        if (!push_handle_path(ctx, msg["handle"].get<uint64_t>(), msg["path"]))
+                        {
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"error", error_to_string(ctx, -1)}}.dump());
+                        }
+                        else
+                        {
+                            json keys = json::array();
+                            if (duk_is_object(ctx, -1))
                             {
-                                duk_get_prop_string(ctx, -1, "stack");
+                                duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+                                while (duk_next(ctx, -1, false))
+                                {
+                                    keys.push_back(duk_get_string(ctx, -1));
+                                    duk_pop(ctx);
+                                }
+                                duk_pop(ctx);
                             }
-                            const char *error = duk_safe_to_string(ctx, -1);
-                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", std::string(error)}}.dump());
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", keys}}.dump());
+                        }
+                        duk_pop(ctx);
+                    }
+                    else if (eventName == "handleSlice")
+                    {
+                        if (!push_handle_path(ctx, msg["handle"].get<uint64_t>(), msg["path"]))
+                        {
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"error", error_to_string(ctx, -1)}}.dump());
                         }
                         else
                         {
-                            json result = duk_to_json(ctx, -1);
-                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", result}}.dump());
+                            // Same bounds as Array.prototype.slice, only the elements in range are converted
+                            double length = duk_is_object(ctx, -1) ? (double)duk_get_length(ctx, -1) : 0;
+                            auto bound = [length](const json &value, double fallback)
+                            {
+                                double index = value.is_number() ? std::trunc(value.get<double>()) : fallback;
+                                return index < 0 ? std::max(length + index, 0.0) : std::min(index, length);
+                            };
+                            double start = bound(msg["start"], 0);
+                            double end = bound(msg["end"], length);
+                            json elements = json::array();
+                            for (double i = start; i < end; ++i)
+                            {
+                                duk_get_prop_index(ctx, -1, (duk_uarridx_t)i);
+                                elements.push_back(duk_to_json(ctx, -1));
+                                duk_pop(ctx);
+                            }
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", elements}}.dump());
                         }
                         duk_pop(ctx);
-                    } else if(eventName=="callFunctionByPointer"){
-                        duk_push_heapptr(ctx, reinterpret_cast<void *>(msg["pointer"].get<uintptr_t>()));
-                         for (const auto arg : msg["args"])
-                             {
-                               json_to_duk(ctx,arg.dump());
+                    }
+                    else if (eventName == "releaseHandles")
+                    {
+                        for (const auto &handle : msg["handles"])
+                        {
+                            release_handle(ctx, handle.get<uint64_t>());
+                        }
+                        emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", true}}.dump());
+                    }
+                    else if (eventName == "compileScript")
+                    {
+                        std::string scriptId;
+                        if (!compile_and_store_script(ctx, msg["code"].get<std::string>(), scriptId))
+                        {
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", error_to_string(ctx, -1)}}.dump());
+                        }
+                        else
+                        {
+                            duk_push_global_object(ctx);
+                            if (duk_pcall_method(ctx, 0) != 0)
+                            {
+                                release_compiled_script(scriptId);
+                                emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", error_to_string(ctx, -1)}}.dump());
+                            }
+                            else
+                            {
+                                json result = {{"script", scriptId}, {"value", duk_to_json(ctx, -1)}};
+                                emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", result}}.dump());
+                            }
+                        }
+                        duk_pop(ctx);
+                    }
+                    else if (eventName == "applyTemplate")
+                    {
+                        std::string error;
+                        const json &steps = msg["steps"];
+                        size_t applied = 0;
+                        for (; applied < steps.size(); ++applied)
+                        {
+                            const json &step = steps[applied];
+                            if (!step.contains("script"))
+                            {
+                                json_to_duk(ctx, step["value"]);
+                                duk_put_global_string(ctx, step["set"].get<std::string>().c_str());
+                                continue;
                             }
-                            if (duk_pcall(ctx,msg["args"].size()) != 0)
-                                 {
-                             emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"error", duk_safe_to_string(ctx, -1)}}.dump());
-                            }else{
 
-                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", duk_to_json(ctx,-1)}}.dump());
+                            auto script = find_compiled_script(step["script"].get<std::string>());
+                            if (!script)
+                            {
+                                error = "Template script is no longer available";
+                                break;
+                            }
+                            if (!push_compiled_script(ctx, *script))
+                            {
+                                error = error_to_string(ctx, -1);
+                                duk_pop(ctx);
+                                break;
+                            }
+                            duk_push_global_object(ctx);
+                            if (duk_pcall_method(ctx, 0) != 0)
+                            {
+                                error = error_to_string(ctx, -1);
+                                duk_pop(ctx);
+                                break;
+                            }
                             duk_pop(ctx);
-                        
+                        }
+                        if (error.empty())
+                        {
+                            take_checkpoint(ctx); // clear({soft: true}) returns to the freshly stamped state
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", true}}.dump());
+                        }
+                        else
+                        {
+                            for (size_t unapplied = applied + 1; unapplied < steps.size(); ++unapplied)
+                            {
+                                release_unsent_host_values(threadData, steps[unapplied]);
                             }
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", error}}.dump());
+                        }
+                    }
+                    else if (eventName == "createRealm")
+                    {
+                        // A shared realm already has the instance's preludes through its builtins and copied bindings
+                        uint32_t id = threadData->sharedBuiltins ? create_shared_realm(ctx) : create_realm(ctx);
+                        duk_context *realmCtx = id ? get_realm_context(ctx, id) : nullptr;
+                        bool prepared = realmCtx && (threadData->sharedBuiltins ? apply_global_profile(realmCtx, threadData->profile) : prepare_globals(realmCtx, threadData));
+                        if (!prepared)
+                        {
+                            dispose_realm(ctx, id);
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", "Failed to set up realm globals"}}.dump());
+                        }
+                        else
+                        {
+                            GasData gas;
+                            gas.gas_limit = msg["gas"]["gasLimit"];
+                            gas.gas_used = 0;
+                            gas.mem_cost_per_byte = msg["gas"]["memCostPerByte"];
+                            threadData->realmGas[id] = gas;
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", id}}.dump());
+                        }
+                    }
+                    else if (eventName == "disposeRealm")
+                    {
+                        uint32_t id = msg["id"];
+                        if (duk_context *realmCtx = get_realm_context(ctx, id))
+                        {
+                            release_thread_handles(ctx, realmCtx);
+                        }
+                        dispose_realm(ctx, id);
+                        threadData->realmGas.erase(id);
+                        emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", true}}.dump());
+                    }
+                    else if (eventName == "checkpoint")
+                    {
+                        take_checkpoint(ctx);
+                        emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", true}}.dump());
+                    }
+                    else if (eventName == "softClear")
+                    {
+                        bool restored = restore_checkpoint(ctx);
+                        if (restored)
+                        {
+                            GasData *gasData = duk_get_gas_info(ctx);
+                            gasData->gas_limit = msg["newGas"]["gasLimit"];
+                            gasData->mem_cost_per_byte = msg["newGas"]["memCostPerByte"];
+                            gasData->gas_used = 0;
+                        }
+                        emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", restored}}.dump());
                     }
                     else if(eventName == "flushContext")
                     {
                         uint32_t newGasLimit = msg["newGas"]["gasLimit"];
                         uint32_t newMemCostPerByte = msg["newGas"]["memCostPerByte"];
 
-                        auto *newGasData = new GasData();
-                        newGasData->gas_limit =9999999;
-                        newGasData->mem_cost_per_byte = 0;
-                        newGasData->gas_used = 0;
-
-                        auto *newHeapConfig = new HeapConfig();
-                        newHeapConfig->gasConfig = newGasData;
-                        newHeapConfig->fatal_function = fatal_handler;
-
-                        duk_context *newCtx = duk_create_heap(duk_gas_respecting_alloc_function, duk_gas_respecting_realloc_function, duk_gas_respecting_free_function, newHeapConfig, (duk_fatal_function)fatal_handler);
-                        newHeapConfig->ctx = (void *)newCtx;
-
-                        // duk_push_bare_object(newCtx);
-                        // duk_set_global_object(newCtx);
-
-                        newGasData->gas_limit = newGasLimit;
-                        newGasData->mem_cost_per_byte = newMemCostPerByte;
-                        newGasData->gas_used = 0;
-                        emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", reinterpret_cast<uintptr_t>(newCtx)}}.dump());
-
-                        duk_destroy_heap(ctx);
-
-                        ctx = newCtx;
+                        PooledHeap newHeap = threadData->localHeap ? create_heap() : acquire_heap();
+                        if (newHeap.ctx && !prepare_heap(newHeap, threadData, newGasLimit, newMemCostPerByte))
+                        {
+                            newHeap = PooledHeap();
+                        }
+                        if (!newHeap.ctx)
+                        {
+                            // ctx is null when clearing after a fatal error
+                            emit_to_node(threadData, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", false}, {"error", "Failed to create Duktape context"}}.dump());
+                        }
+                        else
+                        {
+                            if (ctx)
+                            {
+                                reset_host_functions(ctx, true);
+                                release_heap(threadData->heap);
+                            }
+                            threadData->realmGas.clear();
+                            threadData->heap = newHeap;
+                            ctx = newHeap.ctx;
+                            emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", true}}.dump());
+                        }
                     }else if(eventName=="getGas"){
                         GasData *gasData = duk_get_gas_info(ctx);
                         emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", {{"gasLimit", gasData->gas_limit}, {"gasUsed", gasData->gas_used}, {"memCostPerByte", gasData->mem_cost_per_byte}}}}.dump());
@@ -236,14 +932,11 @@ void create_and_associate_thread(duk_context *ctx)
                         std::string propName = msg["globalName"];
                         duk_get_global_string(ctx, propName.c_str());
 
-                        json result = duk_to_json( ctx, -1);
-
+                        finish_call(ctx, -1, msg, callStartNs);
                         duk_pop(ctx);
-
-                        emit_event_callback(ctx, json{{"event", "callFinished"}, {"callId", msg["callId"]}, {"result", result}}.dump());
                     }else if(eventName=="setGlobal"){
                          std::string propName = msg["globalName"];
-                         json_to_duk(ctx, msg["globalValue"].dump());
+                         json_to_duk(ctx, msg["globalValue"]);
                          duk_put_global_string(ctx, propName.c_str());
                     }
                 }else{//Fatal error happened during execution
@@ -260,49 +953,97 @@ void create_and_associate_thread(duk_context *ctx)
                             }
                         }
                     }.dump());
-                    duk_destroy_heap(ctx);
-                    
-                    
+                    clear_gas_stop(); // a transaction's gas stop points into the heap's gas data
+                    reset_host_functions(ctx, true);
+                    release_heap(threadData->heap);
+                    threadData->heap = PooledHeap();
+                    threadData->realmGas.clear();
+                    ctx = nullptr;
+                    realmGas = threadData->realmGas.end();
+                }
+                if (budgetGas && ctx)
+                {
+                    budgetGas->gas_limit = budgetLimit;
+                }
+                if (realmGas != threadData->realmGas.end())
+                {
+                    realmGas->second = *heapGas;
+                    *heapGas = savedGas;
+                    ctx = heapCtx;
                 }
-                   
+                release_execution_slot();
+                lock.lock();
             }
         }
+
+        // Disposed: fail what is still queued, then give back everything the context owns
+        while (!threadData->messageQueue.empty())
+        {
+            json msg = std::move(threadData->messageQueue.front());
+            threadData->messageQueue.pop();
+            threadData->pendingMessages--;
+            reject_message(threadData, msg, "Context was disposed");
+        }
+        lock.unlock();
+        if (ctx)
+        {
+            reset_host_functions(ctx, false);
+            release_heap(threadData->heap);
+            threadData->heap = PooledHeap();
+        }
+        threadData->realmGas.clear();
+        threadData->channel->post(new ContextEvent{threadData, std::string(), false, std::move(context)});
          });
 
     workerThread.detach();
+    return created.get();
+}
 
+void emit_to_thread(GlomiumContext *threadData, json &&message)
+{
+    bool parked;
     {
-        std::lock_guard<std::mutex> lock(contextThreadMapMutex);
-        contextThreadMap[ctx] = threadData;
+        std::lock_guard<std::mutex> lock(threadData->queueMutex);
+        threadData->messageQueue.push(std::move(message));
+        threadData->lastEnqueueNs = steady_now_ns();
+        threadData->pendingMessages++;
+        parked = threadData->parked;
+    }
+    if (parked)
+    {
+        threadData->cv.notify_one();
     }
 }
 
-void emit_to_thread(duk_context *ctx, const std::string &data)
+void read_idle_policy(napi_env env, napi_value object, IdlePolicy &policy)
 {
-    std::shared_ptr<ThreadData> *threadDataPtr = nullptr;
+    bool hasProp;
+    napi_value prop_value;
+
+    napi_has_named_property(env, object, "spinUs", &hasProp);
+    if (hasProp)
     {
-        std::lock_guard<std::mutex> lock(contextThreadMapMutex);
-        auto it = contextThreadMap.find(ctx);
-        if (it == contextThreadMap.end())
-        {
-            std::cerr << "No thread found for the given context" << std::endl;
-            return;
-        }
-        threadDataPtr = &(it->second);
+        napi_get_named_property(env, object, "spinUs", &prop_value);
+        napi_get_value_uint32(env, prop_value, &policy.spinUs);
     }
 
-    if (threadDataPtr && *threadDataPtr)
+    napi_has_named_property(env, object, "yieldUs", &hasProp);
+    if (hasProp)
     {
+        napi_get_named_property(env, object, "yieldUs", &prop_value);
+        napi_get_value_uint32(env, prop_value, &policy.yieldUs);
+    }
 
-        std::lock_guard<std::mutex> lock((*threadDataPtr)->queueMutex);
-        (*threadDataPtr)->messageQueue.push(data);
-        (*threadDataPtr)->cv.notify_one();
+    napi_has_named_property(env, object, "adaptive", &hasProp);
+    if (hasProp)
+    {
+        napi_get_named_property(env, object, "adaptive", &prop_value);
+        napi_get_value_bool(env, prop_value, &policy.adaptive);
     }
 }
 
 napi_value create_context(napi_env env, napi_callback_info info)
 {
-    Napi::Env napiEnv(env);
     size_t argc = 2;
     napi_value args[2];
     napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
@@ -322,183 +1063,523 @@ napi_value create_context(napi_env env, napi_callback_info info)
     napi_get_named_property(env, args[0], "memCostPerByte", &prop_value);
     napi_get_value_uint32(env, prop_value, &mem_cost_per_byte);
 
-    auto *gasData = new GasData;
-    gasData->gas_limit = 999999; // just a big enough value for Duktape to warm up
-    gasData->gas_used = 0;
-    gasData->mem_cost_per_byte = 0;
-
-    auto *heapConfig = new HeapConfig;
-    heapConfig->gasConfig = gasData;
-
-    heapConfig->fatal_function = fatal_handler;
+    IdlePolicy idlePolicy = default_idle_policy();
+    napi_valuetype idleType;
+    napi_get_named_property(env, args[0], "idle", &prop_value);
+    napi_typeof(env, prop_value, &idleType);
+    if (idleType == napi_object)
+    {
+        read_idle_policy(env, prop_value, idlePolicy);
+    }
 
-    Napi::Function jsEventCallback = Napi::Value(env, args[1]).As<Napi::Function>();
+    // Array of the global bindings to keep, anything else keeps the full global object
+    GlobalProfile profile;
+    bool isArray = false;
+    napi_get_named_property(env, args[0], "profile", &prop_value);
+    napi_is_array(env, prop_value, &isArray);
+    if (isArray)
+    {
+        uint32_t count = 0;
+        napi_get_array_length(env, prop_value, &count);
+        profile.full = false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            napi_value element;
+            size_t nameSize;
+            napi_get_element(env, prop_value, i, &element);
+            if (napi_get_value_string_utf8(env, element, nullptr, 0, &nameSize) != napi_ok)
+            {
+                continue;
+            }
+            std::string name(nameSize, '\0');
+            napi_get_value_string_utf8(env, element, name.data(), nameSize + 1, nullptr);
+            profile.globals.push_back(name);
+        }
+    }
 
-    Napi::ThreadSafeFunction eventCallback = Napi::ThreadSafeFunction::New(
-        napiEnv,
-        jsEventCallback,
-        "EventCallback",
-        0,
-        1,
-        [](Napi::Env) {});
+    // Names of embedded preludes to install, in order
+    std::vector<const EmbeddedPrelude *> preludes;
+    napi_get_named_property(env, args[0], "preludes", &prop_value);
+    napi_is_array(env, prop_value, &isArray);
+    if (isArray)
+    {
+        uint32_t count = 0;
+        napi_get_array_length(env, prop_value, &count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            napi_value element;
+            size_t nameSize = 0;
+            napi_get_element(env, prop_value, i, &element);
+            napi_get_value_string_utf8(env, element, nullptr, 0, &nameSize);
+            std::string name(nameSize, '\0');
+            napi_get_value_string_utf8(env, element, name.data(), nameSize + 1, nullptr);
+            const EmbeddedPrelude *prelude = find_prelude(name);
+            if (!prelude)
+            {
+                napi_throw_type_error(env, nullptr, ("Unknown prelude \"" + name + "\"").c_str());
+                return nullptr;
+            }
+            preludes.push_back(prelude);
+        }
+    }
 
-    duk_context *ctx = duk_create_heap(duk_gas_respecting_alloc_function, duk_gas_respecting_realloc_function, duk_gas_respecting_free_function, heapConfig, (duk_fatal_function)fatal_handler);
-    if (!ctx)
+    bool sharedBuiltins = false;
+    napi_get_named_property(env, args[0], "sharedBuiltins", &prop_value);
+    napi_get_value_bool(env, prop_value, &sharedBuiltins);
+
+    // Only a weak reference to the handler is kept, an idle instance stays collectable
+    AddonEnv *addonEnv = get_addon_env(env);
+    auto context = std::make_shared<GlomiumContext>();
+    context->idlePolicy = idlePolicy;
+    context->profile = profile;
+    context->preludes = preludes;
+    context->sharedBuiltins = sharedBuiltins;
+    context->env = env;
+    context->channel = addonEnv->channel;
+    napi_create_reference(env, args[1], 0, &context->handler);
+
+    if (!start_context_thread(context, gas_limit, mem_cost_per_byte, plan_context_placement()))
     {
-        delete gasData;
-        delete heapConfig;
+        napi_delete_reference(env, context->handler);
         napi_throw_error(env, nullptr, "Failed to create Duktape context");
         return nullptr;
     }
-    heapConfig->ctx = (void *)ctx;
-    // duk_push_bare_object(ctx);
-    // duk_set_global_object(ctx);
-    gasData->gas_limit = gas_limit;
-    gasData->mem_cost_per_byte = mem_cost_per_byte;
-    gasData->gas_used = 0; // we don't really want to count warmup as a used gas as it's not dependent on usercode
+    addonEnv->contexts.insert(context.get());
 
-    {
-        std::lock_guard<std::mutex> lock(EventCallbacksMapMutex);
-        eventCallbacks[ctx] = eventCallback;
-    }
-    create_and_associate_thread(ctx);
     napi_value externalCtx;
-    napi_create_external(env, ctx, nullptr, nullptr, &externalCtx);
+    napi_create_external(env, new std::shared_ptr<GlomiumContext>(context), finalize_context, nullptr, &externalCtx);
 
     return externalCtx;
 }
 
 napi_value call_thread(napi_env env, napi_callback_info info)
 {
-    size_t argc = 2;
-    napi_value args[2];
+    size_t argc = 3;
+    napi_value args[3];
     napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
 
-    if (argc < 2)
+    if (argc < 3)
     {
-        napi_throw_type_error(env, nullptr, "Expected a context and JSON value to pass to thread");
+        napi_throw_type_error(env, nullptr, "Expected a context, a message to pass to thread and a special value encoder");
         return nullptr;
     }
 
-    duk_context *ctx;
-    napi_get_value_external(env, args[0], (void **)&ctx);
+    GlomiumContext *context = get_context(env, args[0]);
+    if (!context)
+    {
+        return nullptr;
+    }
+    if (context->disposed)
+    {
+        napi_throw_error(env, nullptr, "Context was disposed");
+        return nullptr;
+    }
 
-    size_t jsonStrSize;
-    napi_get_value_string_utf8(env, args[1], nullptr, 0, &jsonStrSize);
-    std::string jsonString(jsonStrSize + 1, '\0');
-    napi_get_value_string_utf8(env, args[1], jsonString.data(), jsonStrSize + 1, nullptr);
+    json message;
+    if (!napi_to_json(env, args[1], args[2], message))
+    {
+        return nullptr;
+    }
 
-    emit_to_thread(ctx, jsonString);
+    // Every message is answered by exactly one completing event, the handler stays alive until then
+    napi_reference_ref(env, context->handler, nullptr);
+    context->channel->hold();
+    emit_to_thread(context, std::move(message));
 
     napi_value undefined;
     napi_get_undefined(env, &undefined);
     return undefined;
 }
-napi_value swap_contexts(napi_env env, napi_callback_info info)
+
+napi_value dispose_context(napi_env env, napi_callback_info info)
 {
-    Napi::Env napiEnv(env);
-    size_t argc = 2;
-    napi_value args[2];
+    size_t argc = 1;
+    napi_value args[1];
     napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
 
-    if (argc < 2)
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, nullptr, "Expected a context");
+        return nullptr;
+    }
+
+    GlomiumContext *context = get_context(env, args[0]);
+    if (!context)
     {
-        napi_throw_type_error(env, nullptr, "Expected two arguments");
         return nullptr;
     }
+    stop_context(context);
 
-    duk_context *oldCtx;
-    napi_get_value_external(env, args[0], reinterpret_cast<void **>(&oldCtx));
+    napi_value undefined;
+    napi_get_undefined(env, &undefined);
+    return undefined;
+}
 
-    int64_t newCtxUInt64;
-    napi_get_value_int64(env, args[1], &newCtxUInt64);
-    uintptr_t newCtxPtr = static_cast<uintptr_t>(newCtxUInt64);
-    duk_context *newCtx = reinterpret_cast<duk_context *>(newCtxPtr);
+void emit_to_node(GlomiumContext *context, const std::string &message, bool completesCall)
+{
+    context->channel->post(new ContextEvent{context, message, completesCall, nullptr});
+}
 
+// Realm threads share the heap's gas data, so they reach the same context
+void emit_event_callback(duk_context *ctx, const std::string &message, bool completesCall)
+{
+    emit_to_node(heap_owner(ctx), message, completesCall);
+}
+
+napi_value notify_waiting_execdata(napi_env env, napi_callback_info info)
+{
+    size_t argc = 0;
+    napi_get_cb_info(env, info, &argc, nullptr, nullptr, nullptr);
+
+    if (argc < 5)
     {
-        std::lock_guard<std::mutex> lock(contextThreadMapMutex);
-        auto threadData = contextThreadMap[oldCtx];
-        contextThreadMap[newCtx] = threadData;
-        contextThreadMap.erase(oldCtx);
+        napi_throw_type_error(env, nullptr, "Expected five arguments: context, execution data pointer, response, errored option and special value encoder.");
+        return nullptr;
     }
 
+    napi_value args[5];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+    GlomiumContext *context = get_context(env, args[0]);
+    if (!context)
     {
-        std::lock_guard<std::mutex> lock(EventCallbacksMapMutex);
-        auto eventCallback = eventCallbacks[oldCtx];
-        // std::cout << "Erased ctx " << (void *)oldCtx << ", new context: " << (void *)newCtx << std::endl;
-        eventCallbacks[newCtx] = eventCallback;
-        eventCallbacks.erase(oldCtx);
+        return nullptr;
     }
 
-    contextFunctionMap.erase(oldCtx);
+    int64_t ptrAsInt;
+    napi_get_value_int64(env, args[1], &ptrAsInt);
+    NapiFunctionExecutionData *executionData = reinterpret_cast<NapiFunctionExecutionData *>(ptrAsInt);
+
+    bool errored;
+    napi_get_value_bool(env, args[3], &errored);
+    json response;
+    if (errored)
+    {
+        std::string message;
+        size_t strSize;
+        napi_get_value_string_utf8(env, args[2], nullptr, 0, &strSize);
+        message.resize(strSize);
+        napi_get_value_string_utf8(env, args[2], &message[0], strSize + 1, &strSize);
+        response = std::move(message);
+    }
+    else if (!napi_to_json(env, args[2], args[4], response))
+    {
+        return nullptr; // still waiting, the caller answers with the error instead
+    }
 
-    napi_value newExternalCtx;
-    napi_create_external(env, newCtx, nullptr, nullptr, &newExternalCtx);
+    napi_value result;
+    napi_get_undefined(env, &result);
 
-    return newExternalCtx;
+    // A late answer after stop_context failed the request finds nothing pending, the request may be gone already
+    std::lock_guard<std::mutex> lock(context->queueMutex);
+    if (context->pendingRequest != executionData)
+    {
+        return result;
+    }
+    context->pendingRequest = nullptr;
+    complete_node_request(executionData, std::move(response), errored);
+    return result;
 }
-void emit_event_callback(duk_context *ctx, const std::string &message)
+
+napi_value configure_pool(napi_env env, napi_callback_info info)
 {
-    Napi::ThreadSafeFunction callback;
+    size_t argc = 1;
+    napi_value args[1];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
 
+    if (argc < 1)
     {
-        std::lock_guard<std::mutex> lock(EventCallbacksMapMutex);
-        auto it = eventCallbacks.find(ctx);
-        if (it != eventCallbacks.end())
+        napi_throw_type_error(env, nullptr, "Expected a pool configuration object");
+        return nullptr;
+    }
+
+    ExecutionPoolConfig config;
+    napi_value prop_value;
+
+    napi_get_named_property(env, args[0], "workers", &prop_value);
+    napi_get_value_uint32(env, prop_value, &config.workers);
+    if (config.workers != 0 && !execution_preemption_available())
+    {
+        napi_throw_error(env, nullptr, "Pool workers need Duktape configured with DUK_USE_EXEC_TIMEOUT_CHECK");
+        return nullptr;
+    }
+
+    napi_get_named_property(env, args[0], "sliceMs", &prop_value);
+    napi_get_value_uint32(env, prop_value, &config.sliceMs);
+
+    napi_get_named_property(env, args[0], "idle", &prop_value);
+    read_idle_policy(env, prop_value, config.idle);
+
+    PlacementConfig placement;
+    napi_value placementObject, cpus;
+    napi_get_named_property(env, args[0], "placement", &placementObject);
+
+    napi_get_named_property(env, placementObject, "pin", &prop_value);
+    napi_get_value_bool(env, prop_value, &placement.pin);
+
+    napi_get_named_property(env, placementObject, "numa", &prop_value);
+    napi_get_value_bool(env, prop_value, &placement.numa);
+
+    uint32_t cpuCount = 0;
+    napi_get_named_property(env, placementObject, "cpus", &cpus);
+    napi_get_array_length(env, cpus, &cpuCount);
+    for (uint32_t i = 0; i < cpuCount; ++i)
+    {
+        int32_t cpu;
+        napi_get_element(env, cpus, i, &prop_value);
+        if (napi_get_value_int32(env, prop_value, &cpu) == napi_ok)
         {
-            callback = it->second;
+            placement.cpus.push_back(cpu);
         }
     }
 
-    if (callback)
+    HeapPoolConfig heapPool;
+    napi_value heapPoolObject;
+    napi_get_named_property(env, args[0], "heapPool", &heapPoolObject);
+
+    napi_get_named_property(env, heapPoolObject, "size", &prop_value);
+    napi_get_value_uint32(env, prop_value, &heapPool.size);
+
+    napi_get_named_property(env, heapPoolObject, "lowWatermark", &prop_value);
+    napi_get_value_uint32(env, prop_value, &heapPool.lowWatermark);
+
+    ScriptCacheConfig scriptCache;
+    napi_value scriptCacheObject;
+    napi_get_named_property(env, args[0], "scriptCache", &scriptCacheObject);
+
+    double maxBytes = 0;
+    napi_get_named_property(env, scriptCacheObject, "maxBytes", &prop_value);
+    napi_get_value_double(env, prop_value, &maxBytes);
+    scriptCache.maxBytes = maxBytes > 0 ? (uint64_t)maxBytes : 0;
+
+    size_t directorySize = 0;
+    napi_get_named_property(env, scriptCacheObject, "directory", &prop_value);
+    if (napi_get_value_string_utf8(env, prop_value, nullptr, 0, &directorySize) == napi_ok)
     {
-        std::string *data = new std::string(message);
-        callback.NonBlockingCall(data, call_event_callback);
+        scriptCache.directory.assign(directorySize, '\0');
+        napi_get_value_string_utf8(env, prop_value, scriptCache.directory.data(), directorySize + 1, nullptr);
     }
+
+    configure_execution_pool(config);
+    configure_placement(placement);
+    configure_heap_pool(heapPool);
+    configure_script_cache(scriptCache);
+
+    napi_value undefined;
+    napi_get_undefined(env, &undefined);
+    return undefined;
 }
 
-napi_value notify_waiting_execdata(napi_env env, napi_callback_info info)
+void set_double_property(napi_env env, napi_value object, const char *name, double value)
 {
-    size_t argc = 0;
-    napi_get_cb_info(env, info, &argc, nullptr, nullptr, nullptr);
+    napi_value napiValue;
+    napi_create_double(env, value, &napiValue);
+    napi_set_named_property(env, object, name, napiValue);
+}
 
-    if (argc < 3)
+napi_value get_context_stats(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value args[1];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+    if (argc < 1)
     {
-        napi_throw_type_error(env, nullptr, "Expected three arguments: execution data pointer, response string and errored option.");
+        napi_throw_type_error(env, nullptr, "Expected a context");
         return nullptr;
     }
 
-    napi_value args[3];
+    GlomiumContext *threadData = get_context(env, args[0]);
+    if (!threadData)
+    {
+        return nullptr;
+    }
+
+    napi_value result, idle;
+    napi_create_object(env, &result);
+
+    const IdleStats &stats = threadData->idleStats;
+    auto averageUs = [](uint64_t totalNs, uint64_t count)
+    { return count == 0 ? 0.0 : (double)totalNs / count / 1000.0; };
+
+    napi_create_object(env, &idle);
+    set_double_property(env, idle, "spinWakeups", (double)stats.spinWakeups);
+    set_double_property(env, idle, "yieldWakeups", (double)stats.yieldWakeups);
+    set_double_property(env, idle, "parkWakeups", (double)stats.parkWakeups);
+    set_double_property(env, idle, "avgSpinWakeupLatencyUs", averageUs(stats.spinLatencyNs, stats.spinWakeups));
+    set_double_property(env, idle, "avgYieldWakeupLatencyUs", averageUs(stats.yieldLatencyNs, stats.yieldWakeups));
+    set_double_property(env, idle, "avgParkWakeupLatencyUs", averageUs(stats.parkLatencyNs, stats.parkWakeups));
+    set_double_property(env, idle, "maxWakeupLatencyUs", stats.maxLatencyNs / 1000.0);
+    set_double_property(env, idle, "idleGapUs", stats.idleGapEwmaNs / 1000.0);
+    napi_set_named_property(env, result, "idle", idle);
+
+    const ResultStats &resultStats = threadData->resultStats;
+    napi_value results;
+    napi_create_object(env, &results);
+    set_double_property(env, results, "converted", (double)resultStats.converted);
+    set_double_property(env, results, "discarded", (double)resultStats.discarded);
+    set_double_property(env, results, "picked", (double)resultStats.picked);
+    set_double_property(env, results, "handles", (double)resultStats.handles);
+    set_double_property(env, results, "conversionUs", resultStats.conversionNs / 1000.0);
+    set_double_property(env, results, "bytes", (double)resultStats.bytes);
+    napi_set_named_property(env, result, "results", results);
+
+    return result;
+}
+
+napi_value get_stats(napi_env env, napi_callback_info info)
+{
+    napi_value result, heapPool;
+    napi_create_object(env, &result);
+
+    HeapPoolStats heapPoolStats = heap_pool_stats();
+    napi_create_object(env, &heapPool);
+    set_double_property(env, heapPool, "hits", (double)heapPoolStats.hits);
+    set_double_property(env, heapPool, "misses", (double)heapPoolStats.misses);
+    set_double_property(env, heapPool, "created", (double)heapPoolStats.created);
+    set_double_property(env, heapPool, "available", (double)heapPoolStats.available);
+    napi_set_named_property(env, result, "heapPool", heapPool);
+
+    ScriptCacheStats scriptCacheStats = script_cache_stats();
+    napi_value scriptCache;
+    napi_create_object(env, &scriptCache);
+    set_double_property(env, scriptCache, "hits", (double)scriptCacheStats.hits);
+    set_double_property(env, scriptCache, "misses", (double)scriptCacheStats.misses);
+    set_double_property(env, scriptCache, "evictions", (double)scriptCacheStats.evictions);
+    set_double_property(env, scriptCache, "diskHits", (double)scriptCacheStats.diskHits);
+    set_double_property(env, scriptCache, "diskWrites", (double)scriptCacheStats.diskWrites);
+    set_double_property(env, scriptCache, "bytes", (double)scriptCacheStats.bytes);
+    set_double_property(env, scriptCache, "entries", (double)scriptCacheStats.entries);
+    napi_set_named_property(env, result, "scriptCache", scriptCache);
+
+    return result;
+}
+
+napi_value release_scripts(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value args[1];
     napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
 
-    int64_t ptrAsInt;
-    napi_get_value_int64(env, args[0], &ptrAsInt);
-    NapiFunctionExecutionData *executionData = reinterpret_cast<NapiFunctionExecutionData *>(ptrAsInt);
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, nullptr, "Expected an array of script ids");
+        return nullptr;
+    }
 
-    size_t strSize;
-    napi_get_value_string_utf8(env, args[1], nullptr, 0, &strSize);
-    std::string response(strSize, '\0');
-    napi_get_value_string_utf8(env, args[1], response.data(), response.size() + 1, &strSize);
-    bool errored;
-    napi_get_value_bool(env, args[2], &errored);
+    uint32_t count = 0;
+    napi_get_array_length(env, args[0], &count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        napi_value element;
+        size_t idSize;
+        napi_get_element(env, args[0], i, &element);
+        napi_get_value_string_utf8(env, element, nullptr, 0, &idSize);
+        std::string id(idSize, '\0');
+        napi_get_value_string_utf8(env, element, id.data(), idSize + 1, nullptr);
+        release_compiled_script(id);
+    }
+
+    napi_value undefined;
+    napi_get_undefined(env, &undefined);
+    return undefined;
+}
+
+napi_value native_plugin_to_napi(napi_env env, const NativePluginInfo &info)
+{
+    napi_value result, name, functions;
+    napi_create_object(env, &result);
+    napi_create_string_utf8(env, info.name.c_str(), info.name.size(), &name);
+    napi_set_named_property(env, result, "name", name);
+
+    napi_create_object(env, &functions);
+    for (const auto &function : info.functionIds)
+    {
+        napi_value id;
+        napi_create_int32(env, function.second, &id);
+        napi_set_named_property(env, functions, function.first.c_str(), id);
+    }
+    napi_set_named_property(env, result, "functions", functions);
+    return result;
+}
+
+napi_value load_plugin(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value args[1];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
 
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, nullptr, "Expected a path to the native plugin");
+        return nullptr;
+    }
+
+    size_t pathSize;
+    napi_get_value_string_utf8(env, args[0], nullptr, 0, &pathSize);
+    std::string path(pathSize, '\0');
+    napi_get_value_string_utf8(env, args[0], path.data(), pathSize + 1, nullptr);
+
+    NativePluginInfo plugin;
+    std::string error;
+    if (!load_native_plugin(path, plugin, error))
+    {
+        napi_throw_error(env, nullptr, error.c_str());
+        return nullptr;
+    }
+    return native_plugin_to_napi(env, plugin);
+}
+
+napi_value get_plugin(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value args[1];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, nullptr, "Expected a native plugin name");
+        return nullptr;
+    }
+
+    size_t nameSize;
+    napi_get_value_string_utf8(env, args[0], nullptr, 0, &nameSize);
+    std::string name(nameSize, '\0');
+    napi_get_value_string_utf8(env, args[0], name.data(), nameSize + 1, nullptr);
 
+    NativePluginInfo plugin;
+    if (!get_native_plugin(name, plugin))
     {
-        std::lock_guard<std::mutex> lock(executionData->mtx);
-        executionData->response = std::move(response);
-        executionData->ready = true;
-        executionData->errored = errored;
-        executionData->cv.notify_one();
+        napi_value undefined;
+        napi_get_undefined(env, &undefined);
+        return undefined;
     }
+    return native_plugin_to_napi(env, plugin);
+}
 
+napi_value get_preludes(napi_env env, napi_callback_info info)
+{
+    std::vector<std::string> names = prelude_names();
     napi_value result;
-    napi_get_undefined(env, &result);
+    napi_create_array_with_length(env, names.size(), &result);
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        napi_value name;
+        napi_create_string_utf8(env, names[i].c_str(), names[i].size(), &name);
+        napi_set_element(env, result, i, name);
+    }
     return result;
 }
 
+// Called once per env: the main thread and every worker_thread that requires the addon get their own state
 napi_value Init(napi_env env, napi_value exports)
 {
-    napi_value createContext, callFunctionByPtr, callThread, swapContexts, notifyWaitingExecData;
+    AddonEnv *addonEnv = new AddonEnv;
+    addonEnv->channel = std::make_shared<CompletionChannel>(env, deliver_context_event);
+    napi_set_instance_data(env, addonEnv, finalize_addon_env, nullptr);
+    napi_add_env_cleanup_hook(env, cleanup_addon_env, addonEnv);
+
+    napi_value createContext, callFunctionByPtr, callThread, disposeContext, notifyWaitingExecData, configurePool, loadPlugin, getPlugin, getContextStats, releaseScripts, getStats, getPreludes;
 
     napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, create_context, nullptr, &createContext);
     napi_set_named_property(env, exports, "createContext", createContext);
@@ -506,11 +1587,32 @@ napi_value Init(napi_env env, napi_value exports)
     napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, notify_waiting_execdata, nullptr, &notifyWaitingExecData);
     napi_set_named_property(env, exports, "__notifyWaitingExecData", notifyWaitingExecData);
 
-    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, swap_contexts, nullptr, &swapContexts);
-    napi_set_named_property(env, exports, "__swapContexts", swapContexts);
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, dispose_context, nullptr, &disposeContext);
+    napi_set_named_property(env, exports, "__disposeContext", disposeContext);
 
     napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, call_thread, nullptr, &callThread);
     napi_set_named_property(env, exports, "__callThread", callThread);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, configure_pool, nullptr, &configurePool);
+    napi_set_named_property(env, exports, "configurePool", configurePool);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, load_plugin, nullptr, &loadPlugin);
+    napi_set_named_property(env, exports, "loadPlugin", loadPlugin);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, get_plugin, nullptr, &getPlugin);
+    napi_set_named_property(env, exports, "getPlugin", getPlugin);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, get_context_stats, nullptr, &getContextStats);
+    napi_set_named_property(env, exports, "__getContextStats", getContextStats);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, release_scripts, nullptr, &releaseScripts);
+    napi_set_named_property(env, exports, "__releaseScripts", releaseScripts);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, get_stats, nullptr, &getStats);
+    napi_set_named_property(env, exports, "getStats", getStats);
+
+    napi_create_function(env, nullptr, NAPI_AUTO_LENGTH, get_preludes, nullptr, &getPreludes);
+    napi_set_named_property(env, exports, "getPreludes", getPreludes);
     return exports;
 }
 
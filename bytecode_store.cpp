@@ -0,0 +1,355 @@
+#include "bytecode_store.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern const char *const glomiumDuktapeBuildId; // generated by scripts/build_id.js
+
+namespace
+{
+    const char StoreMagic[4] = {'G', 'L', 'B', 'C'};
+    const uint32_t StoreFormatVersion = 1;
+    // Leftovers of a writer that died mid-write, younger ones may still be renamed into place by another process
+    const int64_t StaleTemporarySeconds = 10 * 60;
+
+    // Followed by the bytecode, then the source. Bytecode comes first so it starts 8-byte aligned in the mapping.
+    struct StoredScriptHeader
+    {
+        char magic[4];
+        uint32_t formatVersion;
+        uint32_t dukVersion;
+        uint32_t reserved;
+        uint64_t buildHash;
+        uint64_t bytecodeSize;
+        uint64_t sourceSize;
+        uint64_t checksum; // over bytecode and source
+    };
+
+    std::mutex storeMutex;
+    std::string storeDirectory;
+
+    uint64_t fnv1a(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Bytecode layout depends on the exact Duktape source and config (glomiumDuktapeBuildId hashes them, so a rebuild
+    // of the addon alone keeps the store valid) and on the platform's value representation
+    uint64_t build_hash()
+    {
+        static const uint64_t hash = []()
+        {
+            const uint32_t probe = 1;
+            const unsigned char platform[] = {(unsigned char)sizeof(void *), (unsigned char)sizeof(double), *(const unsigned char *)&probe};
+            return fnv1a((const char *)platform, sizeof(platform), fnv1a(glomiumDuktapeBuildId, strlen(glomiumDuktapeBuildId)));
+        }();
+        return hash;
+    }
+
+    std::string build_suffix()
+    {
+        char build[32];
+        snprintf(build, sizeof(build), "-%016llx.glbc", (unsigned long long)build_hash());
+        return build;
+    }
+
+    bool ends_with(const std::string &name, const std::string &suffix)
+    {
+        return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Files other builds wrote can never be loaded by this one, and every rebuild of Duktape would otherwise leave a
+    // full set behind. Stale temporary files are removed too.
+    void prune_store(const std::string &directory)
+    {
+        std::string current = build_suffix();
+        std::vector<std::string> doomed;
+        int64_t now = (int64_t)time(nullptr);
+#if defined(_WIN32)
+        WIN32_FIND_DATAA entry;
+        HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &entry);
+        if (search == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+        do
+        {
+            std::string name = entry.cFileName;
+            ULARGE_INTEGER written;
+            written.LowPart = entry.ftLastWriteTime.dwLowDateTime;
+            written.HighPart = entry.ftLastWriteTime.dwHighDateTime;
+            int64_t age = now - (int64_t)(written.QuadPart / 10000000ULL - 11644473600ULL);
+#else
+        DIR *dir = opendir(directory.c_str());
+        if (!dir)
+        {
+            return;
+        }
+        while (dirent *entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            struct stat info;
+            int64_t age = stat((directory + "/" + name).c_str(), &info) == 0 ? now - (int64_t)info.st_mtime : 0;
+#endif
+            if (name.find(".glbc.tmp") != std::string::npos ? age > StaleTemporarySeconds : ends_with(name, ".glbc") && !ends_with(name, current))
+            {
+                doomed.push_back(directory + "/" + name);
+            }
+#if defined(_WIN32)
+        } while (FindNextFileA(search, &entry));
+        FindClose(search);
+#else
+        }
+        closedir(dir);
+#endif
+        for (const std::string &path : doomed)
+        {
+            std::remove(path.c_str());
+        }
+    }
+
+    std::string script_path(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        if (storeDirectory.empty())
+        {
+            return std::string();
+        }
+        return storeDirectory + "/" + key + build_suffix();
+    }
+
+    struct MappedFile
+    {
+        const char *data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
+
+    bool map_file(const std::string &path, MappedFile &mapped)
+    {
+#if defined(_WIN32)
+        mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mapped.file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(mapped.file, &size) || size.QuadPart == 0)
+        {
+            CloseHandle(mapped.file);
+            return false;
+        }
+        mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        mapped.data = mapped.mapping ? static_cast<const char *>(MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        if (!mapped.data)
+        {
+            if (mapped.mapping)
+            {
+                CloseHandle(mapped.mapping);
+            }
+            CloseHandle(mapped.file);
+            return false;
+        }
+        mapped.size = (size_t)size.QuadPart;
+        return true;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        mapped.data = static_cast<const char *>(data);
+        mapped.size = (size_t)info.st_size;
+        return true;
+#endif
+    }
+
+    void unmap_file(MappedFile &mapped)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(mapped.data);
+        CloseHandle(mapped.mapping);
+        CloseHandle(mapped.file);
+#else
+        munmap(const_cast<char *>(mapped.data), mapped.size);
+#endif
+    }
+
+    bool valid_stored_script(const MappedFile &mapped, const std::string &source)
+    {
+        if (mapped.size < sizeof(StoredScriptHeader))
+        {
+            return false;
+        }
+        StoredScriptHeader header;
+        memcpy(&header, mapped.data, sizeof(header));
+        if (memcmp(header.magic, StoreMagic, sizeof(StoreMagic)) != 0 || header.formatVersion != StoreFormatVersion ||
+            header.dukVersion != (uint32_t)DUK_VERSION || header.buildHash != build_hash())
+        {
+            return false;
+        }
+        if (header.sourceSize != source.size() || mapped.size - sizeof(header) < source.size() ||
+            header.bytecodeSize != mapped.size - sizeof(header) - source.size())
+        {
+            return false;
+        }
+        const char *bytecode = mapped.data + sizeof(header);
+        const char *storedSource = bytecode + header.bytecodeSize;
+        return memcmp(storedSource, source.data(), source.size()) == 0 &&
+               fnv1a(storedSource, header.sourceSize, fnv1a(bytecode, header.bytecodeSize)) == header.checksum;
+    }
+
+    struct LoadRequest
+    {
+        const char *bytecode;
+        size_t size;
+    };
+
+    duk_ret_t load_mapped_safe(duk_context *ctx, void *udata)
+    {
+        const LoadRequest *request = static_cast<const LoadRequest *>(udata);
+        duk_push_external_buffer(ctx);
+        duk_config_buffer(ctx, -1, const_cast<char *>(request->bytecode), request->size);
+        duk_load_function(ctx);
+        return 1;
+    }
+}
+
+void configure_bytecode_store(const std::string &directory)
+{
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        if (storeDirectory == directory)
+        {
+            return;
+        }
+        storeDirectory = directory;
+    }
+    if (!directory.empty())
+    {
+        prune_store(directory);
+    }
+}
+
+bool bytecode_store_enabled()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return !storeDirectory.empty();
+}
+
+bool load_stored_script(duk_context *ctx, const std::string &key, const std::string &source, std::string &bytecode)
+{
+    std::string path = script_path(key);
+    MappedFile mapped;
+    if (path.empty() || !map_file(path, mapped))
+    {
+        return false;
+    }
+
+    bool loaded = valid_stored_script(mapped, source);
+    if (loaded)
+    {
+        size_t bytecodeSize = mapped.size - sizeof(StoredScriptHeader) - source.size();
+        LoadRequest request{mapped.data + sizeof(StoredScriptHeader), bytecodeSize};
+        loaded = duk_safe_call(ctx, load_mapped_safe, &request, 0, 1) == DUK_EXEC_SUCCESS;
+        if (loaded)
+        {
+            bytecode.assign(request.bytecode, request.size);
+        }
+        else
+        {
+            duk_pop(ctx);
+        }
+    }
+    unmap_file(mapped);
+    if (!loaded)
+    {
+        // Corrupt, truncated or from an older format: gone now, the caller compiles and writes a fresh one
+        std::remove(path.c_str());
+    }
+    return loaded;
+}
+
+bool store_script(const std::string &key, const std::string &source, const char *bytecode, size_t bytecodeSize)
+{
+    std::string path = script_path(key);
+    if (path.empty())
+    {
+        return false;
+    }
+
+    StoredScriptHeader header = {};
+    memcpy(header.magic, StoreMagic, sizeof(StoreMagic));
+    header.formatVersion = StoreFormatVersion;
+    header.dukVersion = (uint32_t)DUK_VERSION;
+    header.buildHash = build_hash();
+    header.bytecodeSize = bytecodeSize;
+    header.sourceSize = source.size();
+    header.checksum = fnv1a(source.data(), source.size(), fnv1a(bytecode, bytecodeSize));
+
+#if defined(_WIN32)
+    int processId = _getpid();
+#else
+    int processId = (int)getpid();
+#endif
+    std::string temporary = path + ".tmp" + std::to_string(processId) + "-" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(bytecode, (std::streamsize)bytecodeSize);
+        file.write(source.data(), (std::streamsize)source.size());
+        if (!file.good())
+        {
+            file.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+#if defined(_WIN32)
+    if (!MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+#endif
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "duktape.h"
+#include <cstddef>
+#include <string>
+
+// Directory of compiled scripts that survives restarts, one file per source and build. Files are only ever
+// replaced whole (write to a temporary name, then rename), so concurrent processes can share a directory.
+// The directory has to be as trusted as the code itself: bytecode is only checked for integrity, not verified.
+// Files written by other Duktape builds and stale temporary files are deleted when a directory is configured, a file
+// that fails to load is deleted when it is found.
+void configure_bytecode_store(const std::string &directory); // empty disables the store
+bool bytecode_store_enabled();
+// Loads the function stored for source with duk_load_function reading straight from a mapping of the file and
+// leaves it on the stack, copying the bytecode out for the in-memory cache. Returns false with the stack
+// untouched if there is no file, or it was written by another build, is corrupt or holds another source.
+bool load_stored_script(duk_context *ctx, const std::string &key, const std::string &source, std::string &bytecode);
+// Best effort, a failed write only costs a compile after the next restart. Returns whether the file was written.
+bool store_script(const std::string &key, const std::string &source, const char *bytecode, size_t bytecodeSize);
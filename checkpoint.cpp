@@ -0,0 +1,245 @@
+#include "checkpoint.h"
+#include "descriptors.h"
+#include "intrinsics.h"
+
+namespace
+{
+    const char *CheckpointStashKey = "glomiumCheckpoint";
+    const duk_uint_t AllOwnKeys = DUK_ENUM_OWN_PROPERTIES_ONLY | DUK_ENUM_INCLUDE_NONENUMERABLE | DUK_ENUM_INCLUDE_SYMBOLS | DUK_ENUM_NO_PROXY_BEHAVIOR;
+
+    // [ ... ] -> [ ... state ], state is { o: object, p: prototype, e: extensible, k: { key: descriptor } }
+    void push_object_state(duk_context *ctx, duk_idx_t obj)
+    {
+        obj = duk_normalize_index(ctx, obj);
+        duk_push_bare_object(ctx);
+        duk_dup(ctx, obj);
+        duk_put_prop_string(ctx, -2, "o");
+        duk_get_prototype(ctx, obj);
+        duk_put_prop_string(ctx, -2, "p");
+        duk_push_boolean(ctx, is_extensible(ctx, obj));
+        duk_put_prop_string(ctx, -2, "e");
+
+        duk_push_bare_object(ctx);
+        duk_enum(ctx, obj, AllOwnKeys);
+        while (duk_next(ctx, -1, false))
+        {
+            duk_dup(ctx, -1);
+            push_own_descriptor(ctx, obj);
+            duk_put_prop(ctx, -4);
+        }
+        duk_pop(ctx);
+        duk_put_prop_string(ctx, -2, "k");
+    }
+
+    // Same prototype and extensibility as in the snapshot, nothing else is compared
+    bool same_shape(duk_context *ctx, duk_idx_t obj, duk_idx_t state)
+    {
+        obj = duk_normalize_index(ctx, obj);
+        duk_get_prototype(ctx, obj);
+        duk_get_prop_string(ctx, state, "p");
+        bool same = duk_strict_equals(ctx, -1, -2);
+        duk_pop_2(ctx);
+        duk_get_prop_string(ctx, state, "e");
+        same = same && (duk_get_boolean(ctx, -1) != 0) == is_extensible(ctx, obj);
+        duk_pop(ctx);
+        return same;
+    }
+
+    // Object at state's "o" has the same prototype, extensibility, keys and descriptors, accessors are never called
+    bool same_object_state(duk_context *ctx, duk_idx_t state)
+    {
+        state = duk_normalize_index(ctx, state);
+        duk_get_prop_string(ctx, state, "o");
+        duk_idx_t obj = duk_get_top(ctx) - 1;
+        duk_get_prop_string(ctx, state, "k");
+        duk_idx_t saved = duk_get_top(ctx) - 1;
+        bool same = same_shape(ctx, obj, state);
+        duk_size_t count = 0;
+
+        duk_enum(ctx, obj, AllOwnKeys);
+        while (same && duk_next(ctx, -1, false))
+        {
+            count++;
+            duk_dup(ctx, -1);
+            same = duk_get_prop(ctx, saved) != 0;
+            if (same)
+            {
+                duk_dup(ctx, -2);
+                push_own_descriptor(ctx, obj);
+                same = same_descriptor(ctx, -1, -2);
+                duk_pop(ctx);
+            }
+            duk_pop_2(ctx);
+        }
+        duk_pop(ctx);
+
+        if (same)
+        {
+            duk_size_t savedCount = 0;
+            duk_enum(ctx, saved, AllOwnKeys);
+            while (duk_next(ctx, -1, false))
+            {
+                savedCount++;
+                duk_pop(ctx);
+            }
+            duk_pop(ctx);
+            same = count == savedCount;
+        }
+        duk_pop_2(ctx);
+        return same;
+    }
+
+    duk_ret_t take_checkpoint_safe(duk_context *ctx, void *udata)
+    {
+        (void)udata;
+        duk_push_heap_stash(ctx);
+        duk_push_bare_object(ctx); // checkpoint
+
+        duk_push_global_object(ctx);
+        push_object_state(ctx, -1);
+        duk_put_prop_string(ctx, -3, "globals");
+        duk_pop(ctx);
+
+        // builtins: [ state, ... ] of the intrinsics captured before the profile, hidden ones included
+        duk_push_array(ctx);
+        push_intrinsics(ctx);
+        duk_size_t intrinsicCount = duk_get_length(ctx, -1);
+        for (duk_size_t i = 0; i < intrinsicCount; ++i)
+        {
+            duk_get_prop_index(ctx, -1, (duk_uarridx_t)i);
+            push_object_state(ctx, -1);
+            duk_put_prop_index(ctx, -4, (duk_uarridx_t)i);
+            duk_pop(ctx);
+        }
+        duk_pop(ctx);
+        duk_put_prop_string(ctx, -2, "builtins");
+
+        duk_put_prop_string(ctx, -2, CheckpointStashKey);
+        duk_pop(ctx);
+        return 0;
+    }
+
+    // Returns true if restored, false if a builtin was mutated or a global changed more than its value
+    duk_ret_t restore_checkpoint_safe(duk_context *ctx, void *udata)
+    {
+        bool *restored = static_cast<bool *>(udata);
+        duk_push_heap_stash(ctx);
+        duk_get_prop_string(ctx, -1, CheckpointStashKey);
+        duk_idx_t checkpoint = duk_get_top(ctx) - 1;
+
+        duk_get_prop_string(ctx, checkpoint, "builtins");
+        duk_size_t builtinCount = duk_get_length(ctx, -1);
+        for (duk_size_t i = 0; i < builtinCount; ++i)
+        {
+            duk_get_prop_index(ctx, -1, (duk_uarridx_t)i);
+            bool same = same_object_state(ctx, -1);
+            duk_pop(ctx);
+            if (!same)
+            {
+                *restored = false;
+                return 0;
+            }
+        }
+        duk_pop(ctx);
+
+        duk_get_prop_string(ctx, checkpoint, "globals");
+        duk_idx_t state = duk_get_top(ctx) - 1;
+        duk_get_prop_string(ctx, state, "k");
+        duk_idx_t saved = duk_get_top(ctx) - 1;
+        duk_push_global_object(ctx);
+        duk_idx_t global = duk_get_top(ctx) - 1;
+        if (!same_shape(ctx, global, state))
+        {
+            *restored = false;
+            return 0;
+        }
+
+        // Globals that only changed value are put back, anything else about them needs a full flush
+        duk_enum(ctx, saved, AllOwnKeys);
+        while (duk_next(ctx, -1, true))
+        {
+            duk_idx_t desc = duk_get_top(ctx) - 1;
+            duk_dup(ctx, -2);
+            if (duk_has_prop(ctx, global))
+            {
+                duk_dup(ctx, -2);
+                push_own_descriptor(ctx, global);
+                bool sameValue = same_descriptor(ctx, -1, desc);
+                bool sameAttributes = sameValue || same_attributes(ctx, -1, desc);
+                duk_pop(ctx);
+                if (!sameAttributes)
+                {
+                    *restored = false;
+                    return 0;
+                }
+                if (sameValue)
+                {
+                    duk_pop_2(ctx);
+                    continue;
+                }
+            }
+            duk_dup(ctx, -2);
+            define_from_descriptor(ctx, global, desc);
+            duk_pop_2(ctx);
+        }
+        duk_pop(ctx);
+
+        // collect first, deleting while enumerating isn't safe
+        duk_push_array(ctx);
+        duk_uarridx_t addedCount = 0;
+        duk_enum(ctx, global, AllOwnKeys);
+        while (duk_next(ctx, -1, false))
+        {
+            duk_dup(ctx, -1);
+            if (!duk_has_prop(ctx, saved))
+            {
+                duk_put_prop_index(ctx, -3, addedCount++);
+            }
+            else
+            {
+                duk_pop(ctx);
+            }
+        }
+        duk_pop(ctx);
+        for (duk_uarridx_t i = 0; i < addedCount; ++i)
+        {
+            duk_get_prop_index(ctx, -1, i);
+            duk_del_prop(ctx, global); // throws for non-configurable globals, caller falls back to a full flush
+        }
+        duk_pop(ctx);
+
+        duk_pop_n(ctx, 5); // global, saved, state, checkpoint, stash
+        *restored = true;
+        return 0;
+    }
+}
+
+void take_checkpoint(duk_context *ctx)
+{
+    duk_safe_call(ctx, take_checkpoint_safe, nullptr, 0, 1);
+    duk_pop(ctx);
+}
+
+bool restore_checkpoint(duk_context *ctx)
+{
+    duk_push_heap_stash(ctx);
+    bool hasCheckpoint = duk_has_prop_string(ctx, -1, CheckpointStashKey);
+    duk_pop(ctx);
+    if (!hasCheckpoint)
+    {
+        return false;
+    }
+
+    bool restored = false;
+    bool failed = duk_safe_call(ctx, restore_checkpoint_safe, &restored, 0, 1) != DUK_EXEC_SUCCESS;
+    duk_pop(ctx);
+    if (failed || !restored)
+    {
+        return false;
+    }
+
+    // twice, so objects resurrected by finalizers in the first pass are collected too
+    duk_gc(ctx, 0);
+    duk_gc(ctx, 0);
+    return true;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "duktape.h"
+
+// Snapshot of the full property descriptors, prototype and extensibility of the global object and of the intrinsics
+// (captured before the profile, so hidden builtins are covered too), kept in the heap stash. Accessors are never called.
+void take_checkpoint(duk_context *ctx);
+// Deletes globals added since the checkpoint and restores overwritten or deleted ones with their original attributes,
+// then runs a GC. Returns false if there is no checkpoint, a builtin was mutated in any way or a global changed more
+// than its value, in which case the heap has to be rebuilt. Objects reachable from checkpointed globals keep in-place changes.
+bool restore_checkpoint(duk_context *ctx);
@@ -0,0 +1,77 @@
+#include "completion_channel.h"
+
+CompletionChannel::CompletionChannel(napi_env env, CompletionHandler handler) : env(env), deliver(handler)
+{
+    channel = Napi::ThreadSafeFunction::New(Napi::Env(env), Napi::Function(), "CompletionChannel", 0, 1);
+    channel.Unref(env);
+}
+
+void CompletionChannel::drain(napi_env env)
+{
+    std::vector<void *> items;
+    {
+        std::lock_guard<std::mutex> lock(channelMutex);
+        items.swap(postedItems);
+        drainScheduled = false;
+    }
+    for (void *item : items)
+    {
+        deliver(env, item);
+    }
+}
+
+void CompletionChannel::post(void *item)
+{
+    {
+        // The call stays under the lock: once close() has seen the lock free, no poster can reach the released TSFN
+        std::lock_guard<std::mutex> lock(channelMutex);
+        if (!closed)
+        {
+            postedItems.push_back(item);
+            if (!drainScheduled)
+            {
+                drainScheduled = true;
+                // Safe to capture, the channel outlives the TSFN: close() releases it and every poster holds the channel
+                channel.NonBlockingCall([this](Napi::Env env, Napi::Function)
+                                        { drain(env); });
+            }
+            return;
+        }
+    }
+    deliver(nullptr, item);
+}
+
+void CompletionChannel::hold()
+{
+    if (waitingCalls++ == 0)
+    {
+        channel.Ref(env);
+    }
+}
+
+void CompletionChannel::drop()
+{
+    if (waitingCalls != 0 && --waitingCalls == 0)
+    {
+        channel.Unref(env);
+    }
+}
+
+void CompletionChannel::close()
+{
+    std::vector<void *> items;
+    {
+        std::lock_guard<std::mutex> lock(channelMutex);
+        if (closed)
+        {
+            return;
+        }
+        closed = true;
+        items.swap(postedItems);
+    }
+    for (void *item : items)
+    {
+        deliver(nullptr, item);
+    }
+    channel.Release();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <napi.h>
+#include <mutex>
+#include <vector>
+
+// Called with env == nullptr for items posted after the channel closed, the handler only frees those.
+typedef void (*CompletionHandler)(napi_env env, void *item);
+
+// One channel per env for all of its contexts: engine threads post items, a single event loop wakeup delivers
+// all items queued since the previous one, in posting order. The loop is only kept alive while a call waits.
+class CompletionChannel
+{
+public:
+    CompletionChannel(napi_env env, CompletionHandler handler);
+    // Any thread.
+    void post(void *item);
+    // Env thread, around every call that expects a completion.
+    void hold();
+    void drop();
+    // Env thread, on env teardown. Pending and later items are handed to the handler without an env.
+    void close();
+
+private:
+    void drain(napi_env env);
+
+    napi_env env;
+    CompletionHandler deliver;
+    Napi::ThreadSafeFunction channel;
+    std::mutex channelMutex;
+    std::vector<void *> postedItems;
+    bool drainScheduled = false; // an async call is already on its way, later posts ride along with it
+    bool closed = false;
+    uint64_t waitingCalls = 0; // env thread only
+};
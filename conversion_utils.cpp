@@ -1,4 +1,8 @@
 #include "conversion_utils.h"
+#include "scheduler.h"
+#include "native_plugins.h"
+#include "handles.h"
+#include "host_functions.h"
 #include <cstdint>
 #include <vector>
 #include <functional>
@@ -6,15 +10,98 @@
 #include <utility>
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include <unordered_map>
 #include "json.hpp"
 
 using json = nlohmann::json;
 
-extern std::unordered_map<duk_context *, std::unordered_map<int, FunctionContext>> contextFunctionMap;
-extern std::unordered_map<duk_context *, int> contextFunctionCounters;
+void emit_event_callback(duk_context *ctx, const std::string &message, bool completesCall = true);
 
-void emit_event_callback(duk_context *ctx, const std::string &message);
+namespace
+{
+    // [ value ] -> [ value at path ]
+    duk_ret_t push_path_safe(duk_context *ctx, void *udata)
+    {
+        const json *path = static_cast<const json *>(udata);
+        for (const auto &key : *path)
+        {
+            if (!duk_is_object(ctx, -1))
+            {
+                (void) duk_type_error(ctx, "Cannot read a property of a non-object");
+            }
+            // Key goes on the stack first, a throwing getter would longjmp past a C++ temporary
+            if (key.is_number())
+            {
+                duk_push_number(ctx, key.get<double>());
+            }
+            else
+            {
+                const std::string &name = key.get_ref<const std::string &>();
+                duk_push_lstring(ctx, name.data(), name.size());
+            }
+            duk_get_prop(ctx, -2);
+            duk_remove(ctx, -2);
+        }
+        return 1;
+    }
+
+    // Bytes copied by the Node side encoder, kind names the view the guest gets over them
+    void push_buffer(duk_context *ctx, const std::string &kind, const std::string &data)
+    {
+        static const std::unordered_map<std::string, duk_uint_t> bufferKinds = {
+            {"ArrayBuffer", DUK_BUFOBJ_ARRAYBUFFER},
+            {"DataView", DUK_BUFOBJ_DATAVIEW},
+            {"Int8Array", DUK_BUFOBJ_INT8ARRAY},
+            {"Uint8Array", DUK_BUFOBJ_UINT8ARRAY},
+            {"Uint8ClampedArray", DUK_BUFOBJ_UINT8CLAMPEDARRAY},
+            {"Int16Array", DUK_BUFOBJ_INT16ARRAY},
+            {"Uint16Array", DUK_BUFOBJ_UINT16ARRAY},
+            {"Int32Array", DUK_BUFOBJ_INT32ARRAY},
+            {"Uint32Array", DUK_BUFOBJ_UINT32ARRAY},
+            {"Float32Array", DUK_BUFOBJ_FLOAT32ARRAY},
+            {"Float64Array", DUK_BUFOBJ_FLOAT64ARRAY}};
+        auto found = bufferKinds.find(kind);
+        void *bytes = duk_push_fixed_buffer(ctx, data.size());
+        if (!data.empty())
+        {
+            memcpy(bytes, data.data(), data.size());
+        }
+        duk_push_buffer_object(ctx, -1, 0, data.size(), found != bufferKinds.end() ? found->second : DUK_BUFOBJ_UINT8ARRAY);
+        duk_remove(ctx, -2);
+    }
+
+    // Bytes of the buffer at idx as base64, with the name of its view so the Node side rebuilds the same kind
+    json buffer_to_json(duk_context *ctx, duk_idx_t idx)
+    {
+        idx = duk_normalize_index(ctx, idx);
+        std::string kind = "Uint8Array";
+        if (duk_is_object(ctx, idx))
+        {
+            duk_get_prop_string(ctx, idx, "constructor");
+            if (duk_is_object(ctx, -1))
+            {
+                duk_get_prop_string(ctx, -1, "name");
+                if (duk_is_string(ctx, -1))
+                {
+                    kind = duk_get_string(ctx, -1);
+                }
+                duk_pop(ctx);
+            }
+            duk_pop(ctx);
+        }
+        duk_dup(ctx, idx);
+        json props = {{"type", "buffer"}, {"kind", kind}, {"data", duk_base64_encode(ctx, -1)}};
+        duk_pop(ctx);
+        return json{{"__engineInternalProperties", std::move(props)}};
+    }
+}
+
+bool push_path(duk_context *ctx, duk_idx_t idx, const json &path)
+{
+    duk_dup(ctx, idx);
+    return duk_safe_call(ctx, push_path_safe, const_cast<json *>(&path), 1, 1) == DUK_EXEC_SUCCESS;
+}
 
 json duk_to_json(duk_context *ctx, duk_idx_t idx)
 {
@@ -33,7 +120,14 @@ json duk_to_json(duk_context *ctx, duk_idx_t idx)
     case DUK_TYPE_UNDEFINED:
         return json(nullptr);
 
+    case DUK_TYPE_BUFFER:
+        return buffer_to_json(ctx, idx);
+
     case DUK_TYPE_OBJECT:
+        if (duk_is_buffer_data(ctx, idx))
+        {
+            return buffer_to_json(ctx, idx);
+        }
         if (duk_is_array(ctx, idx))
         {
             json array = json::array();
@@ -48,13 +142,9 @@ json duk_to_json(duk_context *ctx, duk_idx_t idx)
         }
         else if (duk_is_function(ctx, idx))
         {
-            duk_dup(ctx, idx);
-            void *heapptr = duk_get_heapptr(ctx, -1);
-          
-
+            // Pinned until the Node side releases it, a bare heap pointer wouldn't keep the function alive
             json funcObject = {
-                {"__engineInternalProperties", {{"type", "function"}, {"heapptr", reinterpret_cast<uintptr_t>(heapptr)}}}};
-            duk_pop(ctx); // Pop the duplicated function
+                {"__engineInternalProperties", {{"type", "function"}, {"handle", pin_handle(ctx, idx)}}}};
             return funcObject;
         }
         else
@@ -80,17 +170,8 @@ json duk_to_json(duk_context *ctx, duk_idx_t idx)
     }
 }
 
-void json_to_duk(duk_context *ctx, const std::string &json_str)
+void json_to_duk(duk_context *ctx, const json &value)
 {
-    json json_obj = json::parse(json_str, nullptr, false);
-
-    if (json_obj.is_discarded())
-    {
-        // Handle invalid JSON.
-        duk_push_error_object(ctx, DUK_ERR_TYPE_ERROR, "Invalid JSON string");
-        return;
-    }
-
     std::function<void(const json &)> push_json;
     push_json = [&ctx, &push_json](const json &obj)
     {
@@ -108,7 +189,8 @@ void json_to_duk(duk_context *ctx, const std::string &json_str)
         }
         else if (obj.is_string())
         {
-            duk_push_string(ctx, obj.get<std::string>().c_str());
+            const std::string &string = obj.get_ref<const std::string &>();
+            duk_push_lstring(ctx, string.data(), string.size());
         }
         else if (obj.is_array())
         {
@@ -126,10 +208,23 @@ void json_to_duk(duk_context *ctx, const std::string &json_str)
                 auto internalProps = obj["__engineInternalProperties"];
                 if (internalProps.contains("type") && internalProps["type"] == "function" && internalProps.contains("id"))
                 {
-                    int functionId = internalProps["id"];
-
-                    duk_push_c_function(ctx, napi_function_wrapper, DUK_VARARGS);
-                    duk_set_magic(ctx, -1, functionId);
+                    push_host_function(ctx, internalProps["id"].get<uint32_t>());
+                }
+                else if (internalProps.contains("type") && internalProps["type"] == "hostObject" && internalProps.contains("id"))
+                {
+                    push_host_object(ctx, internalProps["id"].get<uint32_t>(), internalProps.value("frozen", false));
+                }
+                else if (internalProps.contains("type") && internalProps["type"] == "nativeFunction" && internalProps.contains("id"))
+                {
+                    push_native_function(ctx, internalProps["id"].get<int>());
+                }
+                else if (internalProps.contains("type") && internalProps["type"] == "buffer" && internalProps.contains("data"))
+                {
+                    push_buffer(ctx, internalProps["kind"].get<std::string>(), internalProps["data"].get_ref<const std::string &>());
+                }
+                else
+                {
+                    duk_push_undefined(ctx);
                 }
             }
             else
@@ -149,49 +244,79 @@ void json_to_duk(duk_context *ctx, const std::string &json_str)
         }
     };
 
-    push_json(json_obj);
+    push_json(value);
 }
 
 
-duk_ret_t napi_function_wrapper(duk_context *ctx)
+// Round trip to Node from the engine thread, leaves Node's answer or the error it reported (returns false) on the stack.
+// Callers throw the error once their own C++ locals are gone, duk_throw longjmps past destructors.
+bool request_from_node(duk_context *ctx, json request)
 {
-    int funcId = duk_get_current_magic(ctx);
+    bool errored;
+    {
+        auto executionData = std::make_unique<NapiFunctionExecutionData>();
 
-    int argCount = duk_get_top(ctx);
-    json argsJson = json::array();
+        if (!track_node_request(ctx, executionData.get()))
+        {
+            executionData->response = "Context was disposed";
+            executionData->errored = true;
+        }
+        else
+        {
+            // Cast pointer to int
+            request["executionDataPtr"] = reinterpret_cast<uint64_t>(executionData.get());
+            emit_event_callback(ctx, request.dump(), false);
 
-    for (int i = 0; i < argCount; ++i)
-    {
+            // Guest stays suspended on this thread until Node answers or the context stops, the pool slot goes to other
+            // contexts meanwhile
+            release_execution_slot();
+            {
+                std::unique_lock<std::mutex> lock(executionData->mtx);
+                executionData->cv.wait(lock, [&executionData]
+                                       { return executionData->ready; });
+            }
+            untrack_node_request(ctx);
+            acquire_execution_slot();
+        }
 
-        argsJson.push_back(duk_to_json(ctx, i));
+        errored = executionData->errored;
+        if (errored)
+        {
+            duk_push_error_object(ctx, DUK_ERR_ERROR, "%s", executionData->response.get_ref<const std::string &>().c_str());
+        }
+        else
+        {
+            json_to_duk(ctx, executionData->response);
+        }
     }
-    auto executionData = std::make_unique<NapiFunctionExecutionData>();
+    return !errored;
+}
 
-    // Cast pointer to int
-    uint64_t ptrAsInt = reinterpret_cast<uint64_t>(executionData.get());
+duk_ret_t napi_function_wrapper(duk_context *ctx)
+{
+    bool answered;
+    {
+        int argCount = duk_get_top(ctx);
+        uint32_t funcId = current_host_function(ctx);
+        json argsJson = json::array();
 
-    json callInfo = {
-        {"event", "functionCall"},
-        {"id", funcId},
-        {"args", argsJson},
-        {"executionDataPtr", ptrAsInt}
-    };
+        for (int i = 0; i < argCount; ++i)
+        {
 
-    emit_event_callback(ctx, callInfo.dump());
+            argsJson.push_back(duk_to_json(ctx, i));
+        }
 
-    {
-        std::unique_lock<std::mutex> lock(executionData->mtx);
-        executionData->cv.wait(lock, [&executionData]
-                               { return executionData->ready; });
+        json callInfo = {
+            {"event", "functionCall"},
+            {"id", funcId},
+            {"args", argsJson}
+        };
+        answered = request_from_node(ctx, callInfo);
     }
-
-    if(executionData->errored){
-        (void) duk_error(ctx, DUK_ERR_ERROR, "%s", executionData->response.c_str());
+    if (!answered)
+    {
+        return duk_throw(ctx);
     }
 
-    json_to_duk(ctx, executionData->response);
-
-    executionData->ready = false;
-
     return 1; 
-}
+}
\ No newline at end of file
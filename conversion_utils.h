@@ -11,22 +11,25 @@
 
 using json = nlohmann::json;
 
-struct FunctionContext
-{
-    napi_env env;
-    napi_ref function;
-};
-
 
 struct NapiFunctionExecutionData
 {
     std::condition_variable cv;
     std::mutex mtx;
     bool ready = false;
-    std::string response;
+    json response; // value for json_to_duk, or the error message when errored
     bool errored = false;
 };
 
+// bindings.cpp: registers the request the engine thread is about to wait for with its context, so that stopping the
+// context fails it instead of leaving the thread parked. False if the context is stopping already.
+bool track_node_request(duk_context *ctx, NapiFunctionExecutionData *request);
+void untrack_node_request(duk_context *ctx);
+
 duk_ret_t napi_function_wrapper(duk_context *ctx);
+bool request_from_node(duk_context *ctx, json request);
 json duk_to_json(duk_context *ctx, duk_idx_t idx);
-void json_to_duk(duk_context *ctx, const std::string &json_str);
\ No newline at end of file
+// Pushes the value found by following path (keys and array indexes) from the value at idx. Getters run as guest code,
+// so on failure the error is pushed instead and false returned.
+bool push_path(duk_context *ctx, duk_idx_t idx, const json &path);
+void json_to_duk(duk_context *ctx, const json &value);
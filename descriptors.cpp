@@ -0,0 +1,66 @@
+#include "descriptors.h"
+
+namespace
+{
+    bool same_field(duk_context *ctx, duk_idx_t a, duk_idx_t b, const char *field)
+    {
+        duk_get_prop_string(ctx, a, field);
+        duk_get_prop_string(ctx, b, field);
+        bool same = duk_strict_equals(ctx, -1, -2);
+        duk_pop_2(ctx);
+        return same;
+    }
+
+    bool is_accessor(duk_context *ctx, duk_idx_t desc)
+    {
+        return duk_has_prop_string(ctx, desc, "get") || duk_has_prop_string(ctx, desc, "set");
+    }
+}
+
+void push_own_descriptor(duk_context *ctx, duk_idx_t obj)
+{
+    duk_get_prop_desc(ctx, obj, 0);
+    duk_push_null(ctx);
+    duk_set_prototype(ctx, -2);
+}
+
+void define_from_descriptor(duk_context *ctx, duk_idx_t obj, duk_idx_t desc)
+{
+    duk_uint_t flags = DUK_DEFPROP_FORCE | DUK_DEFPROP_HAVE_ENUMERABLE | DUK_DEFPROP_HAVE_CONFIGURABLE;
+    duk_get_prop_string(ctx, desc, "enumerable");
+    flags |= duk_get_boolean(ctx, -1) ? DUK_DEFPROP_ENUMERABLE : 0;
+    duk_get_prop_string(ctx, desc, "configurable");
+    flags |= duk_get_boolean(ctx, -1) ? DUK_DEFPROP_CONFIGURABLE : 0;
+    duk_pop_2(ctx);
+
+    if (is_accessor(ctx, desc))
+    {
+        duk_get_prop_string(ctx, desc, "get");
+        duk_get_prop_string(ctx, desc, "set");
+        flags |= DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_HAVE_SETTER;
+    }
+    else
+    {
+        duk_get_prop_string(ctx, desc, "writable");
+        flags |= DUK_DEFPROP_HAVE_WRITABLE | (duk_get_boolean(ctx, -1) ? DUK_DEFPROP_WRITABLE : 0);
+        duk_pop(ctx);
+        duk_get_prop_string(ctx, desc, "value");
+        flags |= DUK_DEFPROP_HAVE_VALUE;
+    }
+    duk_def_prop(ctx, obj, flags);
+}
+
+bool same_descriptor(duk_context *ctx, duk_idx_t a, duk_idx_t b)
+{
+    a = duk_normalize_index(ctx, a);
+    b = duk_normalize_index(ctx, b);
+    return same_attributes(ctx, a, b) && same_field(ctx, a, b, "value") && same_field(ctx, a, b, "get") && same_field(ctx, a, b, "set");
+}
+
+bool same_attributes(duk_context *ctx, duk_idx_t a, duk_idx_t b)
+{
+    a = duk_normalize_index(ctx, a);
+    b = duk_normalize_index(ctx, b);
+    return is_accessor(ctx, a) == is_accessor(ctx, b) && same_field(ctx, a, b, "writable") &&
+           same_field(ctx, a, b, "enumerable") && same_field(ctx, a, b, "configurable");
+}
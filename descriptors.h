@@ -0,0 +1,12 @@
+#pragma once
+#include "duktape.h"
+
+// Own property descriptors, read and written through the C API only so no guest getters, setters or Proxy traps run.
+// [ ... key ] -> [ ... desc ], desc has a null prototype so reading it never reaches guest code
+void push_own_descriptor(duk_context *ctx, duk_idx_t obj);
+// [ ... key ] -> [ ... ], defines key on obj exactly as desc describes it, attributes included
+void define_from_descriptor(duk_context *ctx, duk_idx_t obj, duk_idx_t desc);
+// Same attributes and strictly equal value, getter and setter
+bool same_descriptor(duk_context *ctx, duk_idx_t a, duk_idx_t b);
+// Same attributes and kind (data or accessor), whatever the values
+bool same_attributes(duk_context *ctx, duk_idx_t a, duk_idx_t b);
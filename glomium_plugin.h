@@ -0,0 +1,56 @@
+/*
+ * Native plugin interface for Glomium.
+ *
+ * A plugin is a table of Duktape C functions that run directly on the context's worker thread,
+ * without a round trip to Node. Functions must be pure with respect to the host: no Node APIs,
+ * no blocking I/O and no global mutable state shared between contexts.
+ *
+ * Shared library plugins export GLOMIUM_PLUGIN_ENTRY returning a pointer to a static glomium_plugin,
+ * plugins linked into the addon call glomium_register_plugin() instead. Shared library plugins resolve
+ * duk_* symbols from the loaded addon, so they are linked with unresolved symbols allowed
+ * (-undefined dynamic_lookup on macOS) or against the addon's import library on Windows.
+ */
+#pragma once
+#include "duktape.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define GLOMIUM_PLUGIN_ABI_VERSION 1
+#define GLOMIUM_PLUGIN_ENTRY "glomium_plugin_entry"
+
+#if defined(_WIN32)
+#define GLOMIUM_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define GLOMIUM_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct glomium_native_function
+    {
+        const char *name;
+        duk_c_function function;
+        duk_idx_t nargs;       /* DUK_VARARGS for variadic functions */
+        uint32_t gas_base;     /* gas charged on every call */
+        uint32_t gas_per_byte; /* gas charged per byte of string and buffer arguments */
+    } glomium_native_function;
+
+    typedef struct glomium_plugin
+    {
+        uint32_t abi_version; /* GLOMIUM_PLUGIN_ABI_VERSION */
+        const char *name;
+        const glomium_native_function *functions;
+        size_t function_count;
+    } glomium_plugin;
+
+    typedef const glomium_plugin *(*glomium_plugin_entry_function)(void);
+
+    /* Returns 0 on success, -1 if the plugin is malformed or was built against another ABI version. */
+    int glomium_register_plugin(const glomium_plugin *plugin);
+
+#ifdef __cplusplus
+}
+#endif
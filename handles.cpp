@@ -0,0 +1,108 @@
+#include "handles.h"
+#include "conversion_utils.h"
+#include <atomic>
+
+namespace
+{
+    const char *HandlesStashKey = "glomiumHandles";
+    std::atomic<uint64_t> lastHandle{0};
+
+    // [ ... ] -> [ ... handles ]
+    void push_handles(duk_context *ctx)
+    {
+        duk_push_heap_stash(ctx);
+        if (!duk_get_prop_string(ctx, -1, HandlesStashKey))
+        {
+            duk_pop(ctx);
+            duk_push_bare_object(ctx);
+            duk_dup_top(ctx);
+            duk_put_prop_string(ctx, -3, HandlesStashKey);
+        }
+        duk_remove(ctx, -2);
+    }
+}
+
+// Entries are { v: value, t: stash of the thread that pinned it }, so a realm's handles can go with the realm
+uint64_t pin_handle(duk_context *ctx, duk_idx_t idx)
+{
+    idx = duk_normalize_index(ctx, idx);
+    uint64_t handle = ++lastHandle;
+    push_handles(ctx);
+    duk_push_number(ctx, (duk_double_t)handle);
+    duk_push_bare_object(ctx);
+    duk_dup(ctx, idx);
+    duk_put_prop_string(ctx, -2, "v");
+    duk_push_thread_stash(ctx, ctx);
+    duk_put_prop_string(ctx, -2, "t");
+    duk_put_prop(ctx, -3);
+    duk_pop(ctx);
+    return handle;
+}
+
+bool push_handle(duk_context *ctx, uint64_t handle)
+{
+    push_handles(ctx);
+    duk_push_number(ctx, (duk_double_t)handle);
+    if (!duk_get_prop(ctx, -2))
+    {
+        duk_pop_2(ctx);
+        return false;
+    }
+    duk_get_prop_string(ctx, -1, "v");
+    duk_remove(ctx, -2);
+    duk_remove(ctx, -2);
+    return true;
+}
+
+void release_handle(duk_context *ctx, uint64_t handle)
+{
+    push_handles(ctx);
+    duk_push_number(ctx, (duk_double_t)handle);
+    duk_del_prop(ctx, -2);
+    duk_pop(ctx);
+}
+
+void release_thread_handles(duk_context *ctx, duk_context *thread)
+{
+    duk_push_thread_stash(ctx, thread);
+    void *threadStash = duk_get_heapptr(ctx, -1);
+    duk_pop(ctx);
+    push_handles(ctx);
+    duk_idx_t handles = duk_get_top_index(ctx);
+    duk_push_array(ctx); // keys to delete, the table isn't changed while it is enumerated
+    duk_uarridx_t count = 0;
+    duk_enum(ctx, handles, DUK_ENUM_OWN_PROPERTIES_ONLY);
+    while (duk_next(ctx, -1, 1))
+    {
+        duk_get_prop_string(ctx, -1, "t");
+        bool owned = duk_get_heapptr(ctx, -1) == threadStash;
+        duk_pop_2(ctx);
+        if (owned)
+        {
+            duk_put_prop_index(ctx, -3, count++);
+        }
+        else
+        {
+            duk_pop(ctx);
+        }
+    }
+    duk_pop(ctx);
+    for (duk_uarridx_t i = 0; i < count; ++i)
+    {
+        duk_get_prop_index(ctx, -1, i);
+        duk_del_prop(ctx, handles);
+    }
+    duk_pop_2(ctx);
+}
+
+bool push_handle_path(duk_context *ctx, uint64_t handle, const json &path)
+{
+    if (!push_handle(ctx, handle))
+    {
+        duk_push_error_object(ctx, DUK_ERR_REFERENCE_ERROR, "Object is no longer available");
+        return false;
+    }
+    bool found = push_path(ctx, -1, path);
+    duk_remove(ctx, -2);
+    return found;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "duktape.h"
+#include <cstdint>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// Guest values referenced from Node (returned functions, prepared scripts, object handles) are pinned in the heap stash under a handle
+// until Node releases them. Handles are never reused in the process, so one from a heap replaced by clear() finds nothing.
+uint64_t pin_handle(duk_context *ctx, duk_idx_t idx);
+// Pushes the pinned value, or nothing and returns false if the handle is unknown to this heap.
+bool push_handle(duk_context *ctx, uint64_t handle);
+void release_handle(duk_context *ctx, uint64_t handle);
+// Releases every handle pinned while thread (a realm's context) was running, the realm is going away.
+void release_thread_handles(duk_context *ctx, duk_context *thread);
+// push_path from the pinned value
+bool push_handle_path(duk_context *ctx, uint64_t handle, const json &path);
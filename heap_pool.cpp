@@ -0,0 +1,143 @@
+#include "heap_pool.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::mutex heapPoolMutex;
+    std::condition_variable heapPoolCv;
+    HeapPoolConfig heapPoolConfig;
+    HeapPoolStats heapPoolCounters;
+    std::vector<PooledHeap> readyHeaps;
+    bool refillThreadStarted = false;
+
+    bool needs_refill()
+    {
+        size_t available = readyHeaps.size();
+        return available < heapPoolConfig.size && (heapPoolConfig.lowWatermark == 0 || available < heapPoolConfig.lowWatermark);
+    }
+
+    void refill_heaps()
+    {
+        std::unique_lock<std::mutex> lock(heapPoolMutex);
+        while (true)
+        {
+            heapPoolCv.wait(lock, []()
+                            { return needs_refill(); });
+            while (readyHeaps.size() < heapPoolConfig.size)
+            {
+                lock.unlock();
+                PooledHeap heap = create_heap();
+                lock.lock();
+                if (!heap.ctx)
+                {
+                    break;
+                }
+                heapPoolCounters.created++;
+                readyHeaps.push_back(heap);
+            }
+        }
+    }
+}
+
+PooledHeap create_heap()
+{
+    PooledHeap heap;
+    heap.gasData = new HeapGasData;
+    heap.gasData->gas_limit = 999999; // just a big enough value for Duktape to warm up
+    heap.gasData->gas_used = 0;
+    heap.gasData->mem_cost_per_byte = 0;
+
+    heap.heapConfig = new HeapConfig;
+    heap.heapConfig->gasConfig = heap.gasData;
+    heap.heapConfig->fatal_function = fatal_handler;
+
+    heap.ctx = duk_create_heap(duk_gas_respecting_alloc_function, duk_gas_respecting_realloc_function, duk_gas_respecting_free_function, heap.heapConfig, (duk_fatal_function)fatal_handler);
+    if (!heap.ctx)
+    {
+        delete heap.heapConfig;
+        delete heap.gasData;
+        return PooledHeap();
+    }
+    heap.heapConfig->ctx = (void *)heap.ctx;
+    return heap;
+}
+
+PooledHeap acquire_heap()
+{
+    {
+        std::lock_guard<std::mutex> lock(heapPoolMutex);
+        if (!readyHeaps.empty())
+        {
+            PooledHeap heap = readyHeaps.back();
+            readyHeaps.pop_back();
+            heapPoolCounters.hits++;
+            if (needs_refill())
+            {
+                heapPoolCv.notify_one();
+            }
+            return heap;
+        }
+        if (heapPoolConfig.size != 0)
+        {
+            heapPoolCounters.misses++;
+            heapPoolCv.notify_one();
+        }
+    }
+    return create_heap();
+}
+
+void rebind_heap_gas(const PooledHeap &heap, GlomiumContext *owner, uint64_t gasLimit, uint64_t memCostPerByte)
+{
+    heap.gasData->owner = owner;
+    heap.gasData->gas_limit = gasLimit;
+    heap.gasData->mem_cost_per_byte = memCostPerByte;
+    heap.gasData->gas_used = 0; // warmup isn't dependent on usercode, so it isn't counted
+}
+
+void release_heap(const PooledHeap &heap)
+{
+    duk_destroy_heap(heap.ctx);
+    delete heap.heapConfig;
+    delete heap.gasData;
+}
+
+GlomiumContext *heap_owner(duk_context *ctx)
+{
+    return static_cast<HeapGasData *>(duk_get_gas_info(ctx))->owner;
+}
+
+void configure_heap_pool(const HeapPoolConfig &config)
+{
+    std::vector<PooledHeap> surplus;
+    {
+        std::lock_guard<std::mutex> lock(heapPoolMutex);
+        heapPoolConfig = config;
+        while (readyHeaps.size() > heapPoolConfig.size)
+        {
+            surplus.push_back(readyHeaps.back());
+            readyHeaps.pop_back();
+        }
+        if (config.size != 0 && !refillThreadStarted)
+        {
+            refillThreadStarted = true;
+            std::thread(refill_heaps).detach();
+        }
+    }
+    heapPoolCv.notify_one();
+
+    for (const auto &heap : surplus)
+    {
+        release_heap(heap);
+    }
+}
+
+HeapPoolStats heap_pool_stats()
+{
+    std::lock_guard<std::mutex> lock(heapPoolMutex);
+    HeapPoolStats stats = heapPoolCounters;
+    stats.available = (uint32_t)readyHeaps.size();
+    return stats;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "duktape.h"
+#include <cstdint>
+
+struct GlomiumContext; // bindings.cpp
+
+// Heap's gas data, also the O(1) way from a duk_context (duk_get_gas_info) or the heap udata to its context
+struct HeapGasData : GasData
+{
+    GlomiumContext *owner = nullptr;
+};
+
+struct PooledHeap
+{
+    duk_context *ctx = nullptr;
+    HeapConfig *heapConfig = nullptr;
+    HeapGasData *gasData = nullptr;
+};
+
+struct HeapPoolConfig
+{
+    uint32_t size = 0;         // heaps kept ready, 0 disables the pool
+    uint32_t lowWatermark = 0; // refill starts once fewer heaps are left, 0 refills after every pop
+};
+
+struct HeapPoolStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t created = 0;
+    uint32_t available = 0;
+};
+
+void fatal_handler(void *udata, const char *msg); // bindings.cpp
+
+// Creates a heap on the calling thread, with a warmup gas budget and no owner until rebind_heap_gas().
+PooledHeap create_heap();
+// Pops a ready heap or, on a miss, creates one on the calling thread.
+PooledHeap acquire_heap();
+// Destroys the heap along with its gas structures, on the thread that owns it.
+void release_heap(const PooledHeap &heap);
+void rebind_heap_gas(const PooledHeap &heap, GlomiumContext *owner, uint64_t gasLimit, uint64_t memCostPerByte);
+// Context owning the heap ctx (or one of its realm threads) belongs to, nullptr for a heap still in the pool.
+GlomiumContext *heap_owner(duk_context *ctx);
+void configure_heap_pool(const HeapPoolConfig &config);
+HeapPoolStats heap_pool_stats();
@@ -0,0 +1,260 @@
+#include "host_functions.h"
+#include "conversion_utils.h"
+#include <unordered_map>
+
+void emit_event_callback(duk_context *ctx, const std::string &message, bool completesCall);
+
+namespace
+{
+    const char *HostValueIdKey = DUK_HIDDEN_SYMBOL("glomiumHostValue");
+    const char *HostValueGlobalKey = DUK_HIDDEN_SYMBOL("glomiumHostGlobal");
+    const char *HostObjectProxyKey = DUK_HIDDEN_SYMBOL("glomiumHostProxy");
+    const char *HostObjectCacheKey = DUK_HIDDEN_SYMBOL("glomiumHostCache");
+
+    struct HostValueKey
+    {
+        void *global; // realms get their own wrappers, a shared one would leak its realm's builtins
+        uint32_t id;
+
+        bool operator==(const HostValueKey &other) const
+        {
+            return global == other.global && id == other.id;
+        }
+    };
+
+    struct HostValueKeyHash
+    {
+        size_t operator()(const HostValueKey &key) const
+        {
+            return std::hash<void *>()(key.global) ^ (std::hash<uint32_t>()(key.id) << 1);
+        }
+    };
+
+    struct HostValueEntry
+    {
+        // Function wrapper, or a proxy's target which references its proxy. Not a reference itself,
+        // the finalizer removes the entry before the object is freed.
+        void *wrapper;
+        bool proxied;
+        uint64_t uses;
+    };
+
+    thread_local std::unordered_map<HostValueKey, HostValueEntry, HostValueKeyHash> hostValues;
+
+    void emit_released(duk_context *ctx, uint32_t id, uint64_t uses)
+    {
+        emit_event_callback(ctx, json{{"event", "hostValueReleased"}, {"id", id}, {"uses", uses}}.dump(), false);
+    }
+
+    // [ wrapper heapDestruct ]
+    duk_ret_t host_value_finalizer(duk_context *ctx)
+    {
+        if (duk_get_boolean(ctx, 1))
+        {
+            return 0;
+        }
+        duk_get_prop_string(ctx, 0, HostValueGlobalKey);
+        duk_get_prop_string(ctx, 0, HostValueIdKey);
+        HostValueKey key{duk_get_pointer(ctx, -2), duk_get_uint(ctx, -1)};
+        duk_pop_2(ctx);
+        auto it = hostValues.find(key);
+        if (it != hostValues.end() && it->second.wrapper == duk_get_heapptr(ctx, 0))
+        {
+            emit_released(ctx, key.id, it->second.uses);
+            hostValues.erase(it);
+        }
+        return 0;
+    }
+
+    HostValueKey host_value_key(duk_context *ctx, uint32_t id)
+    {
+        duk_push_global_object(ctx);
+        HostValueKey key{duk_get_heapptr(ctx, -1), id};
+        duk_pop(ctx);
+        return key;
+    }
+
+    // Pushes the cached wrapper, if the guest still has one for this realm and id
+    bool push_cached(duk_context *ctx, const HostValueKey &key)
+    {
+        auto it = hostValues.find(key);
+        if (it == hostValues.end())
+        {
+            return false;
+        }
+        it->second.uses++;
+        duk_push_heapptr(ctx, it->second.wrapper);
+        if (it->second.proxied)
+        {
+            duk_get_prop_string(ctx, -1, HostObjectProxyKey);
+            duk_remove(ctx, -2);
+        }
+        return true;
+    }
+
+    // [ ... wrapper ] -> [ ... wrapper ]
+    void register_host_value(duk_context *ctx, const HostValueKey &key, bool proxied)
+    {
+        duk_push_uint(ctx, key.id);
+        duk_put_prop_string(ctx, -2, HostValueIdKey);
+        duk_push_pointer(ctx, key.global);
+        duk_put_prop_string(ctx, -2, HostValueGlobalKey);
+        duk_push_c_function(ctx, host_value_finalizer, 2);
+        duk_set_finalizer(ctx, -2);
+        hostValues[key] = HostValueEntry{duk_get_heapptr(ctx, -1), proxied, 1};
+    }
+
+    // [ target key ... ] -> target's id
+    uint32_t host_object_id(duk_context *ctx)
+    {
+        duk_get_prop_string(ctx, 0, HostValueIdKey);
+        uint32_t id = duk_get_uint(ctx, -1);
+        duk_pop(ctx);
+        return id;
+    }
+
+    // [ target key receiver ]
+    duk_ret_t host_object_get(duk_context *ctx)
+    {
+        if (duk_is_symbol(ctx, 1))
+        {
+            return 0;
+        }
+        duk_safe_to_string(ctx, 1);
+        bool cached = duk_get_prop_string(ctx, 0, HostObjectCacheKey) != 0; // [ target key receiver cache ]
+        if (cached)
+        {
+            duk_dup(ctx, 1);
+            if (duk_get_prop(ctx, 3))
+            {
+                return 1;
+            }
+            duk_pop(ctx);
+        }
+
+        bool answered;
+        {
+            json request = {{"event", "hostObjectGet"}, {"id", host_object_id(ctx)}, {"key", duk_get_string(ctx, 1)}};
+            answered = request_from_node(ctx, request); // [ target key receiver cache [ value cacheable ] ]
+        }
+        if (!answered)
+        {
+            return duk_throw(ctx);
+        }
+        duk_get_prop_index(ctx, -1, 0);
+        duk_get_prop_index(ctx, -2, 1);
+        if (cached && duk_get_boolean(ctx, -1))
+        {
+            duk_dup(ctx, 1);
+            duk_dup(ctx, -3);
+            duk_put_prop(ctx, 3);
+        }
+        duk_pop(ctx);
+        return 1;
+    }
+
+    // [ target key ]
+    duk_ret_t host_object_has(duk_context *ctx)
+    {
+        if (duk_is_symbol(ctx, 1))
+        {
+            duk_push_false(ctx);
+            return 1;
+        }
+        duk_safe_to_string(ctx, 1);
+        bool answered;
+        {
+            json request = {{"event", "hostObjectHas"}, {"id", host_object_id(ctx)}, {"key", duk_get_string(ctx, 1)}};
+            answered = request_from_node(ctx, request);
+        }
+        return answered ? 1 : duk_throw(ctx);
+    }
+
+    // [ target ]
+    duk_ret_t host_object_keys(duk_context *ctx)
+    {
+        bool answered;
+        {
+            json request = {{"event", "hostObjectKeys"}, {"id", host_object_id(ctx)}};
+            answered = request_from_node(ctx, request);
+        }
+        return answered ? 1 : duk_throw(ctx);
+    }
+
+    duk_ret_t host_object_read_only(duk_context *ctx)
+    {
+        (void) duk_type_error(ctx, "Host objects are read-only");
+        return 0;
+    }
+}
+
+void push_host_function(duk_context *ctx, uint32_t id)
+{
+    HostValueKey key = host_value_key(ctx, id);
+    if (push_cached(ctx, key))
+    {
+        return;
+    }
+    duk_push_c_function(ctx, napi_function_wrapper, DUK_VARARGS);
+    register_host_value(ctx, key, false);
+}
+
+void push_host_object(duk_context *ctx, uint32_t id, bool frozen)
+{
+    HostValueKey key = host_value_key(ctx, id);
+    if (push_cached(ctx, key))
+    {
+        return;
+    }
+
+    // Target only carries bookkeeping, it is referenced by nothing but its proxy
+    duk_push_bare_object(ctx);
+    register_host_value(ctx, key, true);
+    if (frozen)
+    {
+        duk_push_bare_object(ctx);
+        duk_put_prop_string(ctx, -2, HostObjectCacheKey);
+    }
+
+    duk_dup_top(ctx);
+    duk_push_bare_object(ctx);
+    duk_push_c_function(ctx, host_object_get, 3);
+    duk_put_prop_string(ctx, -2, "get");
+    duk_push_c_function(ctx, host_object_has, 2);
+    duk_put_prop_string(ctx, -2, "has");
+    duk_push_c_function(ctx, host_object_keys, 1);
+    duk_put_prop_string(ctx, -2, "ownKeys");
+    duk_push_c_function(ctx, host_object_read_only, DUK_VARARGS);
+    duk_put_prop_string(ctx, -2, "set");
+    duk_push_c_function(ctx, host_object_read_only, DUK_VARARGS);
+    duk_put_prop_string(ctx, -2, "deleteProperty");
+    duk_push_c_function(ctx, host_object_read_only, DUK_VARARGS);
+    duk_put_prop_string(ctx, -2, "defineProperty");
+    duk_push_proxy(ctx, 0); // [ ... target proxy ]
+
+    // Proxy and target reference each other, the pair is collected together once the guest drops the proxy
+    duk_dup_top(ctx);
+    duk_put_prop_string(ctx, -3, HostObjectProxyKey);
+    duk_remove(ctx, -2);
+}
+
+uint32_t current_host_function(duk_context *ctx)
+{
+    duk_push_current_function(ctx);
+    duk_get_prop_string(ctx, -1, HostValueIdKey);
+    uint32_t id = duk_get_uint(ctx, -1);
+    duk_pop_2(ctx);
+    return id;
+}
+
+void reset_host_functions(duk_context *ctx, bool notify)
+{
+    if (notify)
+    {
+        for (const auto &entry : hostValues)
+        {
+            emit_released(ctx, entry.first.id, entry.second.uses);
+        }
+    }
+    hostValues.clear();
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "duktape.h"
+#include <cstdint>
+
+// Host functions and by-reference host objects passed in from Node are wrapped once per realm and id, the wrapper
+// is reused until the guest drops it. The registry belongs to the engine thread (one per context), so it needs no
+// locking. Node is told about dropped wrappers (hostValueReleased) with the number of times the id was pushed,
+// so it can tell whether a message still in flight references the value.
+void push_host_function(duk_context *ctx, uint32_t id);
+// Proxy resolving property reads, `in` and key enumeration through Node on demand. Reads of data properties of
+// frozen objects are cached in the guest, everything else asks Node every time. The guest can't modify it.
+void push_host_object(duk_context *ctx, uint32_t id, bool frozen);
+// Id of the host function being called, for napi_function_wrapper.
+uint32_t current_host_function(duk_context *ctx);
+// Forgets every wrapper before the heap is destroyed, finalizers don't report during heap destruction.
+void reset_host_functions(duk_context *ctx, bool notify);
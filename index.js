@@ -1,36 +1,355 @@
 const duktapeBindings = require('./build/Release/duktape_bindings.node');
 
+class NativeFunction {
+    constructor(plugin, name, id) {
+        this.plugin = plugin
+        this.name = name
+        this.id = id
+    }
+}
+
+// Host object the guest reads through a proxy instead of getting a copy, see Glomium.byReference
+class HostReference {
+    constructor(target) {
+        this.target = target
+    }
+}
+
+const engineFunctionHandles = new WeakMap()
+// Guest values pinned for a Node wrapper are released once the wrapper is collected
+// The reference is to the owning instance, a realm wrapper may be collected along with the handles it returned
+const engineHandles = new FinalizationRegistry(({ engine, handle }) => engine.deref()?.__releaseHandle(handle))
+const templateScripts = new FinalizationRegistry(scripts => duktapeBindings.__releaseScripts(scripts))
+// Views a guest buffer can come back as, anything else (a guest subclass, a Duktape Buffer) comes back as a Uint8Array
+const bufferViews = {
+    ArrayBuffer, DataView, Int8Array, Uint8Array, Uint8ClampedArray, Int16Array, Uint16Array,
+    Int32Array, Uint32Array, Float32Array, Float64Array
+}
+
+// Copies the bytes into their own ArrayBuffer, a view of the base64 decode could be misaligned for its kind
+function bufferFromEngine({ kind, data }) {
+    const bytes = Buffer.from(data, "base64")
+    const buffer = bytes.buffer.slice(bytes.byteOffset, bytes.byteOffset + bytes.length)
+    const View = Object.hasOwn(bufferViews, kind) ? bufferViews[kind] : Uint8Array
+    if (View === ArrayBuffer) {
+        return buffer
+    }
+    if (View === DataView) {
+        return new DataView(buffer)
+    }
+    return new View(buffer, 0, Math.floor(buffer.byteLength / View.BYTES_PER_ELEMENT))
+}
+
+class GlomiumTemplate {
+    constructor(builder) {
+        this.builder = builder
+        this.steps = []
+        this.scripts = []
+        templateScripts.register(this, this.scripts)
+    }
+    async set(name, value) {
+        await this.builder.set(name, value)
+        this.steps.push({ set: name, value })
+        return this
+    }
+    async run(code) {
+        const { script, value } = await this.builder.__passToEngine({ event: "compileScript", code })
+        this.scripts.push(script)
+        this.steps.push({ script })
+        return this.builder.__parseValueFromEngine(JSON.stringify(value), this.builder)
+    }
+}
+
+// Function compiled once by compile(), called by handle without shipping its source again
+class GlomiumPreparedScript {
+    constructor(engine, handle) {
+        this.engine = engine
+        this.handle = handle
+        engineHandles.register(this, { engine: new WeakRef(engine.glomium ?? engine), handle }, this)
+    }
+    async call(args = [], options) {
+        return await this.engine.__callHandle(this.handle, args, options)
+    }
+    release() {
+        if (engineHandles.unregister(this)) {
+            this.engine.__releaseHandle(this.handle)
+        }
+    }
+}
+
+// Guest object left in the heap (result: "handle"), each operation converts only the part it touches
+class GlomiumObjectHandle {
+    constructor(engine, handle) {
+        this.engine = engine
+        this.handle = handle
+        engineHandles.register(this, { engine: new WeakRef(engine.glomium ?? engine), handle }, this)
+    }
+    async get(path = [], options) {
+        return this.engine.__parseValueFromEngine(JSON.stringify(await this.engine.__passToEngine({ event: "handleGet", handle: this.handle, path: GlomiumObjectHandle.__path(path), ...this.engine.__callOptions(options) }, options?.onStats)), this.engine)
+    }
+    async keys(path = []) {
+        return await this.engine.__passToEngine({ event: "handleKeys", handle: this.handle, path: GlomiumObjectHandle.__path(path) })
+    }
+    async slice(start, end, path = []) {
+        return this.engine.__parseValueFromEngine(JSON.stringify(await this.engine.__passToEngine({ event: "handleSlice", handle: this.handle, path: GlomiumObjectHandle.__path(path), start, end })), this.engine)
+    }
+    release() {
+        if (engineHandles.unregister(this)) {
+            this.engine.__releaseHandle(this.handle)
+        }
+    }
+    // "a.b.0" or ["a", "b", 0]
+    static __path(path) {
+        if (typeof path === "string") {
+            return path === "" ? [] : path.split(".")
+        }
+        return path.map(key => typeof key === "number" ? key : String(key))
+    }
+}
+
+// Separate global environment inside its parent's heap, served by the parent's engine thread
+class GlomiumRealm {
+    constructor(glomium, id) {
+        this.glomium = glomium
+        this.id = id
+    }
+    async dispose() {
+        await this.glomium.__passToEngine({ event: "disposeRealm", id: this.id })
+    }
+    __callOptions(options) {
+        return this.glomium.__callOptions(options)
+    }
+    __parseValueFromEngine(jsonval, engineClass) {
+        return this.glomium.__parseValueFromEngine(jsonval, engineClass)
+    }
+    __passToEngine(value, onStats) {
+        return this.glomium.__passToEngine({ ...value, realm: this.id }, onStats)
+    }
+    __releaseHandle(handle) {
+        this.glomium.__releaseHandle(handle)
+    }
+}
+
 class Glomium {
+    static poolConfig = {
+        workers: 0,
+        sliceMs: 10,
+        idle: { spinUs: 0, yieldUs: 0, adaptive: false },
+        placement: { cpus: [], pin: false, numa: false },
+        heapPool: { size: 0, lowWatermark: 0 },
+        scriptCache: { maxBytes: 0, directory: "" }
+    }
+    static configurePool(options) {
+        const poolConfig = {
+            ...Glomium.poolConfig,
+            ...options,
+            idle: { ...Glomium.poolConfig.idle, ...options?.idle },
+            placement: { ...Glomium.poolConfig.placement, ...options?.placement },
+            heapPool: { ...Glomium.poolConfig.heapPool, ...options?.heapPool },
+            scriptCache: { ...Glomium.poolConfig.scriptCache, ...options?.scriptCache }
+        }
+        // Throws for settings this build can't honour, the previous configuration stays in place then
+        duktapeBindings.configurePool(poolConfig)
+        Glomium.poolConfig = poolConfig
+        return Glomium.poolConfig
+    }
+    static loadPlugin(path) {
+        return Glomium.__wrapPlugin(duktapeBindings.loadPlugin(path))
+    }
+    static getPlugin(name) {
+        const plugin = duktapeBindings.getPlugin(name)
+        return plugin && Glomium.__wrapPlugin(plugin)
+    }
+    static getStats() {
+        return duktapeBindings.getStats()
+    }
+    static byReference(object) {
+        return new HostReference(object)
+    }
+    static getPreludes() {
+        return duktapeBindings.getPreludes()
+    }
+    static async createTemplate(config, setup) {
+        const builder = new Glomium(config)
+        const template = new GlomiumTemplate(builder)
+        try {
+            await setup(template)
+        } finally {
+            // Steps and compiled scripts are all the template keeps, the scratch instance's thread and heap go now
+            template.builder = null
+            await builder.dispose()
+        }
+        return template
+    }
+    static __wrapPlugin(plugin) {
+        return Object.fromEntries(
+            Object.entries(plugin.functions).map(([name, id]) => [name, new NativeFunction(plugin.name, name, id)])
+        )
+    }
     constructor(config) {
         this.callbackMap=new Map()
+        this.__releasedHandles = []
+        this.__encodeSpecialValue = this.__encodeSpecial.bind(this)
         this.gasLimit = config?.gas?.limit || 100000;
         this.memCostPerByte = config?.gas?.memoryByteCost || 1;
-        this.context = duktapeBindings.createContext({ gasLimit: this.gasLimit, memCostPerByte: this.memCostPerByte },this.__eventHandler.bind(this))
-        this.functionRegistry=[]
+        // Native side only holds the handler weakly while no call is pending, the instance keeps it alive
+        this.__handler = this.__eventHandler.bind(this)
+        this.profile = config?.profile || "full"
+        this.preludes = config?.preludes || []
+        this.context = duktapeBindings.createContext({
+            gasLimit: this.gasLimit,
+            memCostPerByte: this.memCostPerByte,
+            idle: config?.idle,
+            profile: Array.isArray(this.profile) ? this.profile : this.profile === "bare" ? [] : undefined,
+            preludes: this.preludes,
+            sharedBuiltins: config?.sharedBuiltins === true
+        }, this.__handler)
+        this.functionRegistry = new Map()
+        this.__hostValueIds = new WeakMap()
+        this.__hostValueSends = new Map()
+        this.__sentHostValues = null
+        this.__lastHostValueId = 0
+        this.__boundMembers = new WeakMap()
+        this.template = config?.template
+        this.ready = this.template ? this.__passToEngine({ event: "applyTemplate", steps: this.template.steps }).then(() => this) : Promise.resolve(this)
+        this.ready.catch(() => { })
         return this;
     }
     async set(name, value) {
         await this.__passToEngine({event:"setGlobal",globalValue:value,globalName:name})
-        // duktapeBindings.setGlobal(this.context,name, this.__nodeValueToJson(value));
         return this;
     }
 
-    async get(name) {
-        return this.__parseValueFromEngine(JSON.stringify(await this.__passToEngine({ event: "getGlobal", globalName: name })),this)
+    async get(name, options) {
+        return this.__parseValueFromEngine(JSON.stringify(await this.__passToEngine({ event: "getGlobal", globalName: name, ...this.__callOptions(options) }, options?.onStats)),this)
     }
-    async run(code) {
+    async run(code, options) {
 
-        return this.__parseValueFromEngine(JSON.stringify(await this.__passToEngine({ event: "eval", code:code })),this);
+        return this.__parseValueFromEngine(JSON.stringify(await this.__passToEngine({ event: "eval", code:code, ...this.__callOptions(options) }, options?.onStats)),this);
+    }
+    async call(fn, args = [], options) {
+        const handle = engineFunctionHandles.get(fn)
+        if (handle === undefined) {
+            throw new TypeError("Expected a function returned by the engine")
+        }
+        return await this.__callHandle(handle, args, options)
+    }
+    async __callHandle(handle, args, options) {
+        return this.__parseValueFromEngine(JSON.stringify(await this.__passToEngine({ event: "callHandle", handle, args, ...this.__callOptions(options) }, options?.onStats)), this)
+    }
+    // Answers a request of the suspended engine thread, errors are thrown in the guest
+    async __answerEngine(msg, produce) {
+        try {
+            const res = await produce()
+            this.__sendToEngine(() => duktapeBindings.__notifyWaitingExecData(this.context, msg.executionDataPtr, res, false, this.__encodeSpecialValue))
+        } catch (e) {
+            duktapeBindings.__notifyWaitingExecData(this.context, msg.executionDataPtr, e.message, true, this.__encodeSpecialValue)
+        }
+    }
+    // Property of a by-reference host object: methods stay bound to it, nested objects are passed by reference too
+    __hostMember(target, key) {
+        const value = target[key]
+        if (typeof value === "function") {
+            let members = this.__boundMembers.get(target)
+            if (!members) {
+                members = new Map()
+                this.__boundMembers.set(target, members)
+            }
+            let member = members.get(key)
+            if (member?.method !== value) {
+                member = { method: value, bound: value.bind(target) }
+                members.set(key, member)
+            }
+            return member.bound
+        }
+        if (typeof value === "object" && value !== null && !Array.isArray(value) && !(value instanceof NativeFunction) && !(value instanceof HostReference)) {
+            return new HostReference(value)
+        }
+        return value
+    }
+    // Same host function or object always gets the same id, the engine reuses its wrapper for it
+    __hostValueId(value) {
+        let id = this.__hostValueIds.get(value)
+        if (id === undefined) {
+            id = this.__lastHostValueId++
+            this.__hostValueIds.set(value, id)
+            this.functionRegistry.set(id, value)
+        }
+        // Counted per send, the engine reports how many it consumed when the guest drops the wrapper
+        this.__hostValueSends.set(id, (this.__hostValueSends.get(id) || 0) + 1)
+        this.__sentHostValues?.push(id)
+        return id
+    }
+    // Runs a native call that encodes a message, host values counted by it are given back if it throws since nothing
+    // reached the engine then. Messages the engine accepts but never runs are reported back by the engine itself.
+    __sendToEngine(send) {
+        const sent = this.__sentHostValues = []
+        try {
+            return send()
+        } catch (e) {
+            for (const id of sent) {
+                this.__releaseHostValue(id, 1)
+            }
+            throw e
+        } finally {
+            this.__sentHostValues = null
+        }
+    }
+    __releaseHostValue(id, uses) {
+        const sends = (this.__hostValueSends.get(id) || 0) - uses
+        if (sends > 0) {
+            this.__hostValueSends.set(id, sends)
+            return
+        }
+        this.__hostValueIds.delete(this.functionRegistry.get(id))
+        this.functionRegistry.delete(id)
+        this.__hostValueSends.delete(id)
+    }
+    // A GC pass usually finalizes many wrappers at once, their handles go to the engine in one message
+    __releaseHandle(handle) {
+        if (this.__releasedHandles.push(handle) == 1) {
+            queueMicrotask(() => {
+                const handles = this.__releasedHandles
+                this.__releasedHandles = []
+                this.__passToEngine({ event: "releaseHandles", handles }).catch(() => { })
+            })
+        }
+    }
+    async compile(code) {
+        return new GlomiumPreparedScript(this, await this.__passToEngine({ event: "prepareScript", code }))
+    }
+    __callOptions(options) {
+        const callOptions = options?.transaction ? { transaction: true } : {}
+        if (options?.gas !== undefined) {
+            callOptions.gasBudget = options.gas
+        }
+        if (options?.result?.pick) {
+            callOptions.result = { pick: options.result.pick.map(GlomiumObjectHandle.__path) }
+        } else if (options?.result !== undefined) {
+            callOptions.result = options.result
+        }
+        if (typeof options?.onStats === "function") {
+            callOptions.stats = true
+        }
+        return callOptions
     }
     
     
-    async clear() {
-        const newContext = await this.__passToEngine({ event: "flushContext", newGas: { memCostPerByte: this.memCostPerByte, gasLimit: this.gasLimit } })
-
-        this.context = duktapeBindings.__swapContexts(this.context, newContext)
-        this.functionRegistry=[]
+    async checkpoint() {
+        await this.__passToEngine({ event: "checkpoint" })
+        return this;
+    }
+    async clear(options) {
+        const newGas = { memCostPerByte: this.memCostPerByte, gasLimit: this.gasLimit }
+        if (options?.soft && await this.__passToEngine({ event: "softClear", newGas }).catch(() => false)) {
+            return this;
+        }
+        await this.__passToEngine({ event: "flushContext", newGas })
         return this;
     }
+    dispose() {
+        duktapeBindings.__disposeContext(this.context)
+    }
     async setGas({limit, memoryByteCost,used}) {
         return await this.__passToEngine({
             event: "setGas", gasData: {
@@ -39,6 +358,16 @@ class Glomium {
                 used:used||0
         } })
     }
+    async createRealm(config) {
+        const gas = {
+            gasLimit: config?.gas?.limit || this.gasLimit,
+            memCostPerByte: config?.gas?.memoryByteCost ?? this.memCostPerByte
+        }
+        return new GlomiumRealm(this, await this.__passToEngine({ event: "createRealm", gas }))
+    }
+    getStats() {
+        return duktapeBindings.__getContextStats(this.context)
+    }
     async getGas() {
         return await this.__passToEngine({
             event: "getGas"
@@ -49,22 +378,32 @@ class Glomium {
 
         const msg = JSON.parse(data)
         let event = ({
-            "functionCall":async  () => {
-                let execDataPointer=msg.executionDataPtr
-                let res;
-                try{
-                res = await this.functionRegistry[msg.id](...msg.args)
-                duktapeBindings.__notifyWaitingExecData(execDataPointer,this.__nodeValueToJson(res),false)
-                }catch(e){
-                duktapeBindings.__notifyWaitingExecData(execDataPointer,e.message,true)
-                }
+            "functionCall": () => this.__answerEngine(msg, () => {
+                return this.functionRegistry.get(msg.id)(...this.__parseValueFromEngine(JSON.stringify(msg.args), this))
+            }),
+            "hostObjectGet": () => this.__answerEngine(msg, () => {
+                const target = this.functionRegistry.get(msg.id)
+                const descriptor = Object.getOwnPropertyDescriptor(target, msg.key)
+                // Data properties of frozen objects never change, the guest may keep them
+                return [this.__hostMember(target, msg.key), Object.isFrozen(target) && descriptor !== undefined && "value" in descriptor]
+            }),
+            "hostObjectHas": () => this.__answerEngine(msg, () => msg.key in this.functionRegistry.get(msg.id)),
+            "hostObjectKeys": () => this.__answerEngine(msg, () => Object.keys(this.functionRegistry.get(msg.id))),
+            "hostValueReleased": () => {
+                this.__releaseHostValue(msg.id, msg.uses)
             },
             "callFinished": () => {
                 // console.log("Node got:",msg)
                 const prom = this.callbackMap.get(msg.callId)
-                if(!msg.result&&msg.error){
+                if (msg.gasInfo) {
+                    // Transactional call stopped at its gas limit and rolled back, the heap is still there
+                    prom.reject({ message: msg.error, gasInfo: msg.gasInfo })
+                } else if(!msg.result&&msg.error){
                     prom.reject(msg.error)
                 }else{
+                    if (msg.stats) {
+                        prom.onStats?.(msg.stats)
+                    }
                     prom.resolve(msg.result);
                 }
                
@@ -101,12 +440,24 @@ class Glomium {
                     if (typeof o.__engineInternalProperties == "object") {
                         or = (({
                             "function": () => {
-                                return async (...args) => {
+                                const handle = o.__engineInternalProperties.handle
+                                const fn = async (...args) => {
 
-                                    return await engineClass.__passToEngine({ event: "callFunctionByPointer", pointer: o.__engineInternalProperties.heapptr, args:args})
+                                    return await engineClass.__callHandle(handle, args)
                                
                             }
-                        }})[o.__engineInternalProperties.type])()
+                                fn.release = () => {
+                                    if (engineHandles.unregister(fn)) {
+                                        engineClass.__releaseHandle(handle)
+                                    }
+                                }
+                                engineFunctionHandles.set(fn, handle)
+                                engineHandles.register(fn, { engine: new WeakRef(engineClass.glomium ?? engineClass), handle }, fn)
+                                return fn
+                            },
+                            "objectHandle": () => new GlomiumObjectHandle(engineClass, o.__engineInternalProperties.handle),
+                            "buffer": () => bufferFromEngine(o.__engineInternalProperties)
+                        })[o.__engineInternalProperties.type])()
                     } else {
                         or=Object.fromEntries(
                             Object.entries(o).map(([k, v]) => [k, parseSpecialObjects(v)])
@@ -122,51 +473,40 @@ class Glomium {
         return jsonparsed
     }
 
-    __nodeValueToJson(val) {
-    const convertToJson = (value) => {
-        if (value === null) {
-            return null;
-        } else if (value === undefined) {
-            return {
-                __engineInternalProperties: { type: 'undefined' }
-            };
-        } else if (typeof value === 'function') {
-            return {
-                __engineInternalProperties: {
-                    type: 'function',
-                    id: this.functionRegistry.push(value) - 1,
-                    name: value.name
-                }
-            };
-        } else if (typeof value === 'object') {
-            if (Array.isArray(value)) {
-                return value.map(item => convertToJson(item));
-            } else {
-                const obj = {};
-                for (const [key, item] of Object.entries(value)) {
-                    if (key !== '__engineInternalProperties') {
-                        obj[key] = convertToJson(item);
-                    }
-                }
-                return obj;
-            }
-        } else {
-            return value;
+    // Called by the native encoder for functions and class instances, plain data never comes through here
+    __encodeSpecial(value) {
+        if (typeof value === 'function') {
+            return { type: 'function', id: this.__hostValueId(value), name: value.name }
+        } else if (value instanceof HostReference) {
+            return { type: 'hostObject', id: this.__hostValueId(value.target), frozen: Object.isFrozen(value.target) }
+        } else if (value instanceof NativeFunction) {
+            return { type: 'nativeFunction', id: value.id, name: value.name }
         }
-    };
-
-    const jsonValue = convertToJson(val);
-    return JSON.stringify(jsonValue);
+        return undefined
     }
-    __passToEngine(value) {
+    __passToEngine(value, onStats) {
         return new Promise((re, rj) => {
             const id = (Date.now() + Math.floor(Math.random() * (10 ** 12))).toString(32)
-            this.callbackMap.set(id, {resolve:re,reject:rj})
-            duktapeBindings.__callThread(this.context, this.__nodeValueToJson({ ...value, callId: id }))
+            this.callbackMap.set(id, {resolve:re,reject:rj,onStats})
+            try {
+                this.__sendToEngine(() => duktapeBindings.__callThread(this.context, { ...value, callId: id }, this.__encodeSpecialValue))
+            } catch (e) {
+                this.callbackMap.delete(id)
+                throw e
+            }
         })
 
        
 
     }
 }
+for (const method of ["set", "get", "run", "call", "__callHandle", "compile", "setGas", "getGas"]) {
+    GlomiumRealm.prototype[method] = Glomium.prototype[method]
+}
+Glomium.NativeFunction = NativeFunction
+Glomium.HostReference = HostReference
+Glomium.GlomiumRealm = GlomiumRealm
+Glomium.GlomiumPreparedScript = GlomiumPreparedScript
+Glomium.GlomiumObjectHandle = GlomiumObjectHandle
+Glomium.GlomiumTemplate = GlomiumTemplate
 module.exports=Glomium
\ No newline at end of file
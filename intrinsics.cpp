@@ -0,0 +1,152 @@
+#include "intrinsics.h"
+#include "descriptors.h"
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    const char *IntrinsicsStashKey = "glomiumIntrinsics";
+    const char *IsExtensibleStashKey = "glomiumIsExtensible";
+
+    const char *const BuiltinNames[] = {
+        "Object", "Function", "Array", "String", "Boolean", "Number", "Date", "RegExp",
+        "Error", "EvalError", "RangeError", "ReferenceError", "SyntaxError", "TypeError", "URIError",
+        "JSON", "Math", "Duktape", "Proxy", "Reflect", "Symbol", "Promise",
+        "ArrayBuffer", "DataView", "Int8Array", "Uint8Array", "Uint8ClampedArray", "Int16Array",
+        "Uint16Array", "Int32Array", "Uint32Array", "Float32Array", "Float64Array", "TextEncoder", "TextDecoder"};
+
+    struct LockdownWalk
+    {
+        void *global;
+        std::unordered_set<void *> visited;
+        std::vector<void *> pending; // reachable from the stashed intrinsics, so nothing is collected mid-walk
+    };
+
+    void enqueue_for_lockdown(duk_context *ctx, duk_idx_t idx, LockdownWalk &walk)
+    {
+        if (!duk_is_object(ctx, idx))
+        {
+            return;
+        }
+        void *ptr = duk_get_heapptr(ctx, idx);
+        if (ptr != walk.global && walk.visited.insert(ptr).second)
+        {
+            walk.pending.push_back(ptr);
+        }
+    }
+
+    duk_ret_t lock_down_intrinsics_safe(duk_context *ctx, void *udata)
+    {
+        (void)udata;
+        LockdownWalk walk;
+        duk_push_global_object(ctx);
+        walk.global = duk_get_heapptr(ctx, -1);
+        duk_pop(ctx);
+        push_intrinsics(ctx);
+        duk_size_t count = duk_get_length(ctx, -1);
+        for (duk_size_t i = 0; i < count; ++i)
+        {
+            duk_get_prop_index(ctx, -1, (duk_uarridx_t)i);
+            enqueue_for_lockdown(ctx, -1, walk);
+            duk_pop(ctx);
+        }
+        duk_pop(ctx);
+
+        const char *const fields[] = {"value", "get", "set"};
+        while (!walk.pending.empty())
+        {
+            duk_push_heapptr(ctx, walk.pending.back());
+            walk.pending.pop_back();
+            duk_idx_t obj = duk_get_top(ctx) - 1;
+            duk_get_prototype(ctx, obj);
+            enqueue_for_lockdown(ctx, -1, walk);
+            duk_pop(ctx);
+            duk_enum(ctx, obj, DUK_ENUM_OWN_PROPERTIES_ONLY | DUK_ENUM_INCLUDE_NONENUMERABLE | DUK_ENUM_INCLUDE_SYMBOLS | DUK_ENUM_NO_PROXY_BEHAVIOR);
+            while (duk_next(ctx, -1, false))
+            {
+                push_own_descriptor(ctx, obj);
+                for (const char *field : fields)
+                {
+                    duk_get_prop_string(ctx, -1, field);
+                    enqueue_for_lockdown(ctx, -1, walk);
+                    duk_pop(ctx);
+                }
+                duk_pop(ctx);
+            }
+            duk_pop(ctx); // enum
+            duk_freeze(ctx, obj);
+            duk_pop(ctx);
+        }
+        return 0;
+    }
+
+    duk_ret_t capture_intrinsics_safe(duk_context *ctx, void *udata)
+    {
+        (void)udata;
+        duk_push_thread_stash(ctx, ctx);
+        duk_push_array(ctx);
+        duk_uarridx_t count = 0;
+        duk_push_global_object(ctx);
+        for (const char *name : BuiltinNames)
+        {
+            if (!duk_get_prop_string(ctx, -1, name) || !duk_is_object(ctx, -1))
+            {
+                duk_pop(ctx);
+                continue;
+            }
+            if (duk_get_prop_string(ctx, -1, "prototype") && duk_is_object(ctx, -1))
+            {
+                duk_put_prop_index(ctx, -4, count++);
+            }
+            else
+            {
+                duk_pop(ctx);
+            }
+            duk_put_prop_index(ctx, -3, count++);
+        }
+        duk_get_prop_string(ctx, -1, "Object");
+        duk_get_prop_string(ctx, -1, "isExtensible");
+        duk_put_prop_string(ctx, -5, IsExtensibleStashKey);
+        duk_pop_2(ctx); // Object, global
+        duk_put_prop_string(ctx, -2, IntrinsicsStashKey);
+        duk_pop(ctx);
+        return 0;
+    }
+}
+
+void capture_intrinsics(duk_context *ctx)
+{
+    duk_safe_call(ctx, capture_intrinsics_safe, nullptr, 0, 1);
+    duk_pop(ctx);
+}
+
+void push_intrinsics(duk_context *ctx)
+{
+    duk_push_thread_stash(ctx, ctx);
+    if (!duk_get_prop_string(ctx, -1, IntrinsicsStashKey))
+    {
+        duk_pop(ctx);
+        duk_push_array(ctx);
+    }
+    duk_remove(ctx, -2);
+}
+
+bool is_extensible(duk_context *ctx, duk_idx_t idx)
+{
+    idx = duk_normalize_index(ctx, idx);
+    duk_push_thread_stash(ctx, ctx);
+    duk_get_prop_string(ctx, -1, IsExtensibleStashKey);
+    duk_remove(ctx, -2);
+    duk_dup(ctx, idx);
+    duk_call(ctx, 1); // throws if nothing was captured, callers run under duk_safe_call
+    bool extensible = duk_to_boolean(ctx, -1);
+    duk_pop(ctx);
+    return extensible;
+}
+
+bool lock_down_intrinsics(duk_context *ctx)
+{
+    bool lockedDown = duk_safe_call(ctx, lock_down_intrinsics_safe, nullptr, 0, 1) == DUK_EXEC_SUCCESS;
+    duk_pop(ctx);
+    return lockedDown;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "duktape.h"
+
+// Builtin constructors, their prototypes and namespace objects (JSON, Math, ...). Guest code reaches them through
+// literals ({}.constructor, [].constructor, ...) whatever the global profile hides, so they are captured from the
+// untouched global object before preludes and the profile run, and kept in the thread's stash.
+void capture_intrinsics(duk_context *ctx);
+// [ ... ] -> [ ... intrinsics ], an array of the captured objects, empty if nothing was captured
+void push_intrinsics(duk_context *ctx);
+// Object.isExtensible as captured. Duktape answers it from the object's own flag, Proxy traps aren't consulted.
+bool is_extensible(duk_context *ctx, duk_idx_t idx);
+// Freezes the intrinsics and everything reachable from them (properties, accessors, prototypes), the global object
+// excepted. Needed before realms share them. Returns false if something couldn't be frozen.
+bool lock_down_intrinsics(duk_context *ctx);
@@ -0,0 +1,255 @@
+#include "journal.h"
+#include "descriptors.h"
+#include "intrinsics.h"
+#include "scheduler.h"
+#include <limits>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    const char *JournalStashKey = "glomiumJournal";
+    // Gas a transactional call may overshoot its limit by before the fork's fatal check fires. The gas stop runs at the
+    // executor interrupt, so this covers the instructions and allocations between two interrupts.
+    const uint64_t TransactionGasReserve = 1000000;
+
+    // Limit of the running transactional call, the heap's own limit is raised by the reserve meanwhile
+    thread_local uint64_t transactionGasLimit = 0;
+
+    const uint64_t UnlimitedGas = std::numeric_limits<decltype(GasData::gas_limit)>::max();
+    const duk_uint_t JournalKeys = DUK_ENUM_OWN_PROPERTIES_ONLY | DUK_ENUM_INCLUDE_NONENUMERABLE | DUK_ENUM_INCLUDE_SYMBOLS | DUK_ENUM_NO_PROXY_BEHAVIOR;
+
+    struct JournalWalk
+    {
+        std::unordered_set<void *> visited;
+        std::vector<void *> pending; // everything here is reachable from the global object, so it can't be collected mid-walk
+    };
+
+    void enqueue_object(duk_context *ctx, duk_idx_t idx, JournalWalk &walk)
+    {
+        if (!duk_is_object(ctx, idx))
+        {
+            return;
+        }
+        void *ptr = duk_get_heapptr(ctx, idx);
+        if (walk.visited.insert(ptr).second)
+        {
+            walk.pending.push_back(ptr);
+        }
+    }
+
+    // Descriptor can't change anymore once its object isn't extensible either
+    bool is_locked_descriptor(duk_context *ctx, duk_idx_t desc)
+    {
+        duk_get_prop_string(ctx, desc, "configurable");
+        duk_get_prop_string(ctx, desc, "writable");
+        bool locked = !duk_get_boolean(ctx, -2) && !duk_get_boolean(ctx, -1);
+        duk_pop_2(ctx);
+        return locked;
+    }
+
+    duk_ret_t begin_transaction_safe(duk_context *ctx, void *udata)
+    {
+        (void)udata;
+        JournalWalk walk;
+        duk_push_heap_stash(ctx);
+        duk_push_bare_object(ctx); // journal: index -> { o: object, p: prototype, e: extensible, k: { key: descriptor } }
+        duk_uarridx_t count = 0;
+
+        // Intrinsics too, the profile may have hidden them from the global while literals still reach them
+        duk_push_global_object(ctx);
+        enqueue_object(ctx, -1, walk);
+        duk_pop(ctx);
+        push_intrinsics(ctx);
+        duk_size_t intrinsicCount = duk_get_length(ctx, -1);
+        for (duk_size_t i = 0; i < intrinsicCount; ++i)
+        {
+            duk_get_prop_index(ctx, -1, (duk_uarridx_t)i);
+            enqueue_object(ctx, -1, walk);
+            duk_pop(ctx);
+        }
+        duk_pop(ctx);
+
+        while (!walk.pending.empty())
+        {
+            void *ptr = walk.pending.back();
+            walk.pending.pop_back();
+
+            duk_push_bare_object(ctx);
+            duk_push_heapptr(ctx, ptr);
+            duk_idx_t obj = duk_get_top(ctx) - 1;
+            duk_dup(ctx, obj);
+            duk_put_prop_string(ctx, -3, "o");
+            duk_get_prototype(ctx, obj);
+            enqueue_object(ctx, -1, walk);
+            duk_put_prop_string(ctx, -3, "p");
+            bool extensible = is_extensible(ctx, obj);
+            duk_push_boolean(ctx, extensible);
+            duk_put_prop_string(ctx, -3, "e");
+
+            bool frozen = !extensible;
+            duk_push_bare_object(ctx);
+            duk_enum(ctx, obj, JournalKeys);
+            while (duk_next(ctx, -1, false))
+            {
+                duk_dup(ctx, -1);
+                push_own_descriptor(ctx, obj);
+                frozen = frozen && is_locked_descriptor(ctx, -1);
+                const char *const fields[] = {"value", "get", "set"};
+                for (const char *field : fields)
+                {
+                    duk_get_prop_string(ctx, -1, field);
+                    enqueue_object(ctx, -1, walk);
+                    duk_pop(ctx);
+                }
+                duk_put_prop(ctx, -4);
+            }
+            duk_pop(ctx); // enum
+            duk_put_prop_string(ctx, -3, "k");
+            duk_pop(ctx); // object
+            if (frozen)
+            {
+                duk_pop(ctx); // nothing about it can change, frozen builtins mostly
+            }
+            else
+            {
+                duk_put_prop_index(ctx, -2, count++);
+            }
+        }
+        duk_push_uint(ctx, count);
+        duk_put_prop_string(ctx, -2, "count");
+        duk_put_prop_string(ctx, -2, JournalStashKey);
+        duk_pop(ctx);
+        return 0;
+    }
+
+    duk_ret_t rollback_transaction_safe(duk_context *ctx, void *udata)
+    {
+        bool *complete = static_cast<bool *>(udata);
+        duk_push_heap_stash(ctx);
+        duk_get_prop_string(ctx, -1, JournalStashKey);
+        duk_idx_t journal = duk_get_top(ctx) - 1;
+        duk_get_prop_string(ctx, journal, "count");
+        duk_uarridx_t count = duk_get_uint(ctx, -1);
+        duk_pop(ctx);
+
+        for (duk_uarridx_t i = 0; i < count; ++i)
+        {
+            duk_get_prop_index(ctx, journal, i);
+            duk_get_prop_string(ctx, -1, "o");
+            duk_idx_t obj = duk_get_top(ctx) - 1;
+            duk_get_prop_string(ctx, -2, "k");
+            duk_idx_t saved = duk_get_top(ctx) - 1;
+
+            // added keys, collected first since deleting while enumerating isn't safe
+            duk_push_bare_object(ctx);
+            duk_uarridx_t addedCount = 0;
+            duk_enum(ctx, obj, JournalKeys);
+            while (duk_next(ctx, -1, false))
+            {
+                duk_dup(ctx, -1);
+                if (!duk_has_prop(ctx, saved))
+                {
+                    duk_put_prop_index(ctx, -3, addedCount++);
+                }
+                else
+                {
+                    duk_pop(ctx);
+                }
+            }
+            duk_pop(ctx);
+            for (duk_uarridx_t added = 0; added < addedCount; ++added)
+            {
+                duk_get_prop_index(ctx, -1, added);
+                duk_del_prop(ctx, obj); // throws for non-configurable properties, reported as incomplete rollback
+            }
+            duk_pop(ctx);
+
+            duk_enum(ctx, saved, DUK_ENUM_OWN_PROPERTIES_ONLY | DUK_ENUM_INCLUDE_NONENUMERABLE | DUK_ENUM_INCLUDE_SYMBOLS);
+            while (duk_next(ctx, -1, true))
+            {
+                duk_idx_t desc = duk_get_top(ctx) - 1;
+                duk_dup(ctx, -2);
+                define_from_descriptor(ctx, obj, desc);
+                duk_pop_2(ctx);
+            }
+            duk_pop(ctx);
+
+            duk_get_prop_string(ctx, -3, "p");
+            duk_set_prototype(ctx, obj);
+            // preventExtensions() can't be undone
+            duk_get_prop_string(ctx, -3, "e");
+            if (duk_get_boolean(ctx, -1) && !is_extensible(ctx, obj))
+            {
+                *complete = false;
+            }
+            duk_pop(ctx);
+            duk_pop_3(ctx); // entry, object, saved
+        }
+        duk_pop_2(ctx);
+        return 0;
+    }
+
+    void drop_journal(duk_context *ctx)
+    {
+        duk_push_heap_stash(ctx);
+        duk_del_prop_string(ctx, -1, JournalStashKey);
+        duk_pop(ctx);
+    }
+}
+
+void begin_transaction(duk_context *ctx)
+{
+    // The journal is the engine's bookkeeping, the guest's gas only pays for what the call itself does
+    GasData *gasData = duk_get_gas_info(ctx);
+    GasData savedGas = *gasData;
+    gasData->gas_limit = 0x7fffffff;
+    if (duk_safe_call(ctx, begin_transaction_safe, nullptr, 0, 1) != DUK_EXEC_SUCCESS)
+    {
+        drop_journal(ctx);
+    }
+    duk_pop(ctx);
+    gasData->gas_used = savedGas.gas_used;
+
+    // Out of gas has to leave a heap to roll back: the call is stopped at its limit, the fatal check only past the reserve
+    transactionGasLimit = savedGas.gas_limit;
+    gasData->gas_limit = savedGas.gas_limit > UnlimitedGas - TransactionGasReserve ? UnlimitedGas : savedGas.gas_limit + TransactionGasReserve;
+    set_gas_stop(gasData, savedGas.gas_limit);
+}
+
+bool transaction_out_of_gas(duk_context *ctx)
+{
+    return duk_get_gas_info(ctx)->gas_used > transactionGasLimit;
+}
+
+bool rollback_transaction(duk_context *ctx)
+{
+    GasData *gasData = duk_get_gas_info(ctx);
+    uint64_t gasUsed = gasData->gas_used;
+    clear_gas_stop();
+    gasData->gas_limit = UnlimitedGas;
+
+    duk_push_heap_stash(ctx);
+    bool hasJournal = duk_has_prop_string(ctx, -1, JournalStashKey);
+    duk_pop(ctx);
+    bool rolledBack = false;
+    if (hasJournal)
+    {
+        bool complete = true;
+        rolledBack = duk_safe_call(ctx, rollback_transaction_safe, &complete, 0, 1) == DUK_EXEC_SUCCESS && complete;
+        duk_pop(ctx);
+        drop_journal(ctx);
+        duk_gc(ctx, 0);
+    }
+
+    gasData->gas_used = gasUsed;
+    gasData->gas_limit = transactionGasLimit;
+    return rolledBack;
+}
+
+void commit_transaction(duk_context *ctx)
+{
+    clear_gas_stop();
+    duk_get_gas_info(ctx)->gas_limit = transactionGasLimit;
+    drop_journal(ctx);
+}
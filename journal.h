@@ -0,0 +1,23 @@
+#pragma once
+#include "duktape.h"
+
+// Transactional calls. begin_transaction() journals the property descriptors, prototype and extensibility of every
+// object reachable from the global object and the intrinsics, through the C API only, so no guest getters or Proxy
+// traps run. Frozen objects are walked but not journaled. The walk isn't charged to the guest's gas.
+// rollback_transaction() puts all of them back, commit_transaction() drops the journal.
+// Not covered: variables captured in closures and buffer contents.
+//
+// Begin and rollback cost time proportional to the reachable state, not to what the call writes. Journaling only the
+// objects a call writes needs a write barrier in Duktape's property code, which the C API doesn't offer. Contracts
+// with large state graphs should keep their state small or use clear({ soft: true }) instead.
+//
+// Running out of gas is rolled back too: the call is stopped with a catchable error once it passes its limit, the
+// heap's own limit is raised by a reserve meanwhile, so the fork's fatal check only fires if the call overshoots
+// its limit by more than that between two interrupt checks. Needs DUK_USE_EXEC_TIMEOUT_CHECK, otherwise out of gas stays fatal.
+void begin_transaction(duk_context *ctx);
+// True once the running transactional call was stopped for passing its gas limit. Call before rollback or commit.
+bool transaction_out_of_gas(duk_context *ctx);
+// Returns false if the journal couldn't be fully applied (e.g. a non-configurable property was added, or an object
+// was made non-extensible).
+bool rollback_transaction(duk_context *ctx);
+void commit_transaction(duk_context *ctx);
@@ -0,0 +1,260 @@
+#include "napi_encoder.h"
+#include <string>
+
+namespace
+{
+    const int MaxDepth = 1000;
+    const char *InternalKey = "__engineInternalProperties";
+
+    struct Encoder
+    {
+        napi_env env;
+        napi_value encodeSpecial;
+        napi_value objectPrototype;
+    };
+
+    json internal_value(const char *type)
+    {
+        return json{{InternalKey, {{"type", type}}}};
+    }
+
+    json buffer_value(const char *kind, const void *data, size_t length)
+    {
+        // Only handed to json_to_duk, never dumped, so the bytes can sit in a string as they are
+        json props = {{"type", "buffer"}, {"kind", kind}, {"data", std::string(static_cast<const char *>(data), length)}};
+        return json{{InternalKey, std::move(props)}};
+    }
+
+    const char *typed_array_kind(napi_typedarray_type type, size_t &elementSize)
+    {
+        switch (type)
+        {
+        case napi_int8_array: elementSize = 1; return "Int8Array";
+        case napi_uint8_array: elementSize = 1; return "Uint8Array";
+        case napi_uint8_clamped_array: elementSize = 1; return "Uint8ClampedArray";
+        case napi_int16_array: elementSize = 2; return "Int16Array";
+        case napi_uint16_array: elementSize = 2; return "Uint16Array";
+        case napi_int32_array: elementSize = 4; return "Int32Array";
+        case napi_uint32_array: elementSize = 4; return "Uint32Array";
+        case napi_float32_array: elementSize = 4; return "Float32Array";
+        case napi_float64_array: elementSize = 8; return "Float64Array";
+        default: elementSize = 0; return nullptr;
+        }
+    }
+
+    bool get_string(napi_env env, napi_value value, std::string &out)
+    {
+        size_t length;
+        if (napi_get_value_string_utf8(env, value, nullptr, 0, &length) != napi_ok)
+        {
+            return false;
+        }
+        out.resize(length);
+        return napi_get_value_string_utf8(env, value, &out[0], length + 1, &length) == napi_ok;
+    }
+
+    bool encode(Encoder &encoder, napi_value value, json &out, int depth);
+
+    // Functions and class instances, false with a pending exception; handled is false when the callback leaves it to us
+    bool encode_special(Encoder &encoder, napi_value value, json &out, bool &handled, int depth)
+    {
+        napi_env env = encoder.env;
+        napi_value undefined, props;
+        napi_get_undefined(env, &undefined);
+        if (napi_call_function(env, undefined, encoder.encodeSpecial, 1, &value, &props) != napi_ok)
+        {
+            return false;
+        }
+        napi_valuetype type;
+        napi_typeof(env, props, &type);
+        handled = type != napi_undefined;
+        if (!handled)
+        {
+            return true;
+        }
+        json encoded;
+        if (!encode(encoder, props, encoded, depth + 1))
+        {
+            return false;
+        }
+        out = json{{InternalKey, std::move(encoded)}};
+        return true;
+    }
+
+    bool encode_object(Encoder &encoder, napi_value value, json &out, int depth)
+    {
+        napi_env env = encoder.env;
+        bool is;
+        if (napi_is_typedarray(env, value, &is) == napi_ok && is)
+        {
+            napi_typedarray_type type;
+            size_t length, elementSize;
+            void *data;
+            napi_get_typedarray_info(env, value, &type, &length, &data, nullptr, nullptr);
+            const char *kind = typed_array_kind(type, elementSize);
+            if (!kind)
+            {
+                napi_throw_type_error(env, nullptr, "BigInt arrays can't be passed to the engine");
+                return false;
+            }
+            out = buffer_value(kind, data, length * elementSize);
+            return true;
+        }
+        if (napi_is_dataview(env, value, &is) == napi_ok && is)
+        {
+            size_t length;
+            void *data;
+            napi_get_dataview_info(env, value, &length, &data, nullptr, nullptr);
+            out = buffer_value("DataView", data, length);
+            return true;
+        }
+        if (napi_is_arraybuffer(env, value, &is) == napi_ok && is)
+        {
+            size_t length;
+            void *data;
+            napi_get_arraybuffer_info(env, value, &data, &length);
+            out = buffer_value("ArrayBuffer", data, length);
+            return true;
+        }
+        if (napi_is_array(env, value, &is) == napi_ok && is)
+        {
+            uint32_t length;
+            napi_get_array_length(env, value, &length);
+            out = json::array();
+            for (uint32_t i = 0; i < length; i++)
+            {
+                napi_value element;
+                json encoded;
+                if (napi_get_element(env, value, i, &element) != napi_ok || !encode(encoder, element, encoded, depth + 1))
+                {
+                    return false;
+                }
+                out.push_back(std::move(encoded));
+            }
+            return true;
+        }
+
+        napi_value prototype, null;
+        napi_get_prototype(env, value, &prototype);
+        napi_get_null(env, &null);
+        bool plain, bare;
+        napi_strict_equals(env, prototype, encoder.objectPrototype, &plain);
+        napi_strict_equals(env, prototype, null, &bare);
+        if (!plain && !bare)
+        {
+            bool handled;
+            if (!encode_special(encoder, value, out, handled, depth))
+            {
+                return false;
+            }
+            if (handled)
+            {
+                return true;
+            }
+        }
+
+        // Own enumerable string keys, as Object.entries sees them
+        napi_value keys;
+        if (napi_get_all_property_names(env, value, napi_key_own_only, static_cast<napi_key_filter>(napi_key_enumerable | napi_key_skip_symbols),
+                                        napi_key_numbers_to_strings, &keys) != napi_ok)
+        {
+            return false;
+        }
+        uint32_t length;
+        napi_get_array_length(env, keys, &length);
+        out = json::object();
+        for (uint32_t i = 0; i < length; i++)
+        {
+            napi_value key, item;
+            std::string name;
+            napi_get_element(env, keys, i, &key);
+            if (!get_string(env, key, name))
+            {
+                return false;
+            }
+            if (name == InternalKey)
+            {
+                continue;
+            }
+            if (napi_get_property(env, value, key, &item) != napi_ok || !encode(encoder, item, out[name], depth + 1))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool encode(Encoder &encoder, napi_value value, json &out, int depth)
+    {
+        napi_env env = encoder.env;
+        if (depth > MaxDepth)
+        {
+            napi_throw_range_error(env, nullptr, "Value is nested too deeply to pass to the engine");
+            return false;
+        }
+        napi_valuetype type;
+        napi_typeof(env, value, &type);
+        switch (type)
+        {
+        case napi_undefined:
+        case napi_symbol:
+            out = internal_value("undefined");
+            return true;
+        case napi_null:
+            out = nullptr;
+            return true;
+        case napi_boolean:
+        {
+            bool boolean;
+            napi_get_value_bool(env, value, &boolean);
+            out = boolean;
+            return true;
+        }
+        case napi_number:
+        {
+            double number;
+            napi_get_value_double(env, value, &number);
+            out = number;
+            return true;
+        }
+        case napi_string:
+        {
+            std::string string;
+            if (!get_string(env, value, string))
+            {
+                return false;
+            }
+            out = std::move(string);
+            return true;
+        }
+        case napi_function:
+        {
+            bool handled;
+            if (!encode_special(encoder, value, out, handled, depth))
+            {
+                return false;
+            }
+            if (!handled)
+            {
+                out = internal_value("undefined");
+            }
+            return true;
+        }
+        case napi_object:
+            return encode_object(encoder, value, out, depth);
+        default:
+            napi_throw_type_error(env, nullptr, "Value can't be passed to the engine");
+            return false;
+        }
+    }
+}
+
+bool napi_to_json(napi_env env, napi_value value, napi_value encodeSpecial, json &out)
+{
+    Encoder encoder{env, encodeSpecial, nullptr};
+    napi_value global, object;
+    napi_get_global(env, &global);
+    napi_get_named_property(env, global, "Object", &object);
+    napi_get_named_property(env, object, "prototype", &encoder.objectPrototype);
+    return encode(encoder, value, out, 0);
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <node_api.h>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// Encodes a Node value for json_to_duk on the main thread without a JSON.stringify round trip. Typed arrays, Buffers, DataViews
+// and ArrayBuffers are copied as bytes. Functions and class instances go through encodeSpecial, which returns the
+// __engineInternalProperties of host functions, host objects and native functions, or undefined to copy own properties instead.
+// On failure a JS exception is pending and false returned.
+bool napi_to_json(napi_env env, napi_value value, napi_value encodeSpecial, json &out);
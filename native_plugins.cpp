@@ -0,0 +1,191 @@
+#include "native_plugins.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+    const int MaxNativeFunctions = 32767; // function id is stored as Duktape magic, which is 16 bit
+
+    struct RegisteredPlugin
+    {
+        std::string name;
+        std::unordered_map<std::string, int> functionIds;
+    };
+
+    std::mutex nativeRegistryMutex; // registration only
+    std::vector<std::unique_ptr<glomium_native_function>> nativeFunctions; // entries are never removed, ids stay valid
+    std::unordered_map<std::string, RegisteredPlugin> nativePlugins;
+    // Append-only table of the same entries, published once each is complete. Engine threads look functions up on
+    // every guest call without taking the lock.
+    std::atomic<const glomium_native_function *> nativeFunctionTable[MaxNativeFunctions] = {};
+
+    const glomium_native_function *native_function_by_id(int functionId)
+    {
+        if (functionId < 0 || functionId >= MaxNativeFunctions)
+        {
+            return nullptr;
+        }
+        return nativeFunctionTable[functionId].load(std::memory_order_acquire);
+    }
+
+    duk_ret_t native_function_trampoline(duk_context *ctx)
+    {
+        const glomium_native_function *function = native_function_by_id(duk_get_current_magic(ctx));
+        if (!function)
+        {
+            return duk_error(ctx, DUK_ERR_ERROR, "Native function is not registered");
+        }
+
+        uint64_t cost = function->gas_base;
+        if (function->gas_per_byte != 0)
+        {
+            duk_idx_t argCount = duk_get_top(ctx);
+            for (duk_idx_t i = 0; i < argCount; ++i)
+            {
+                duk_size_t size = 0;
+                if (duk_is_string(ctx, i))
+                {
+                    duk_get_lstring(ctx, i, &size);
+                }
+                else if (duk_is_buffer_data(ctx, i))
+                {
+                    duk_get_buffer_data(ctx, i, &size);
+                }
+                cost += (uint64_t)size * function->gas_per_byte;
+            }
+        }
+
+        GasData *gasData = duk_get_gas_info(ctx);
+        gasData->gas_used += cost;
+        if (gasData->gas_used > gasData->gas_limit)
+        {
+            duk_fatal(ctx, "Out of gas");
+        }
+
+        return function->function(ctx);
+    }
+
+    bool register_plugin_locked(const glomium_plugin *plugin, RegisteredPlugin **out)
+    {
+        if (!plugin || plugin->abi_version != GLOMIUM_PLUGIN_ABI_VERSION || !plugin->name || (!plugin->functions && plugin->function_count != 0))
+        {
+            return false;
+        }
+
+        auto existing = nativePlugins.find(plugin->name);
+        if (existing != nativePlugins.end())
+        {
+            *out = &existing->second;
+            return true;
+        }
+        if (nativeFunctions.size() + plugin->function_count > (size_t)MaxNativeFunctions)
+        {
+            return false;
+        }
+
+        RegisteredPlugin registered;
+        registered.name = plugin->name;
+        for (size_t i = 0; i < plugin->function_count; ++i)
+        {
+            const glomium_native_function &function = plugin->functions[i];
+            if (!function.name || !function.function)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < plugin->function_count; ++i)
+        {
+            int functionId = (int)nativeFunctions.size();
+            registered.functionIds[plugin->functions[i].name] = functionId;
+            nativeFunctions.push_back(std::make_unique<glomium_native_function>(plugin->functions[i]));
+            nativeFunctionTable[functionId].store(nativeFunctions.back().get(), std::memory_order_release);
+        }
+
+        *out = &(nativePlugins[registered.name] = std::move(registered));
+        return true;
+    }
+}
+
+extern "C" int glomium_register_plugin(const glomium_plugin *plugin)
+{
+    std::lock_guard<std::mutex> lock(nativeRegistryMutex);
+    RegisteredPlugin *registered;
+    return register_plugin_locked(plugin, &registered) ? 0 : -1;
+}
+
+bool load_native_plugin(const std::string &path, NativePluginInfo &info, std::string &error)
+{
+#if defined(_WIN32)
+    HMODULE library = LoadLibraryA(path.c_str());
+    if (!library)
+    {
+        error = "Failed to load native plugin " + path;
+        return false;
+    }
+    auto entry = reinterpret_cast<glomium_plugin_entry_function>(GetProcAddress(library, GLOMIUM_PLUGIN_ENTRY));
+#else
+    // Node loads the addon with local symbol scope, promote it so the plugin's duk_* references resolve against our Duktape
+    Dl_info self;
+    if (dladdr(reinterpret_cast<void *>(&glomium_register_plugin), &self) && self.dli_fname)
+    {
+        dlopen(self.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_GLOBAL);
+    }
+    void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+    {
+        error = dlerror();
+        return false;
+    }
+    auto entry = reinterpret_cast<glomium_plugin_entry_function>(dlsym(library, GLOMIUM_PLUGIN_ENTRY));
+#endif
+    // Plugins are never unloaded, contexts may hold their functions for the lifetime of the process
+    if (!entry)
+    {
+        error = "Native plugin " + path + " doesn't export " GLOMIUM_PLUGIN_ENTRY;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(nativeRegistryMutex);
+    RegisteredPlugin *registered;
+    if (!register_plugin_locked(entry(), &registered))
+    {
+        error = "Native plugin " + path + " is malformed or built for another plugin ABI version";
+        return false;
+    }
+    info.name = registered->name;
+    info.functionIds = registered->functionIds;
+    return true;
+}
+
+bool get_native_plugin(const std::string &name, NativePluginInfo &info)
+{
+    std::lock_guard<std::mutex> lock(nativeRegistryMutex);
+    auto it = nativePlugins.find(name);
+    if (it == nativePlugins.end())
+    {
+        return false;
+    }
+    info.name = it->second.name;
+    info.functionIds = it->second.functionIds;
+    return true;
+}
+
+void push_native_function(duk_context *ctx, int functionId)
+{
+    const glomium_native_function *function = native_function_by_id(functionId);
+    if (!function)
+    {
+        duk_push_undefined(ctx);
+        return;
+    }
+    duk_push_c_function(ctx, native_function_trampoline, function->nargs);
+    duk_set_magic(ctx, -1, functionId);
+}
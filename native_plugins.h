@@ -0,0 +1,15 @@
+#pragma once
+#include "duktape.h"
+#include "glomium_plugin.h"
+#include <string>
+#include <unordered_map>
+
+struct NativePluginInfo
+{
+    std::string name;
+    std::unordered_map<std::string, int> functionIds;
+};
+
+bool load_native_plugin(const std::string &path, NativePluginInfo &info, std::string &error);
+bool get_native_plugin(const std::string &name, NativePluginInfo &info);
+void push_native_function(duk_context *ctx, int functionId);
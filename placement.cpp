@@ -0,0 +1,231 @@
+#include "placement.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace
+{
+    std::mutex placementMutex;
+    PlacementConfig placementConfig;
+    std::atomic<unsigned> nextPinnedCpu{0};
+
+    // One CPU number of a list, false unless the whole of [text, end) is a non-negative number
+    bool parse_cpu(const char *text, const char *end, int &cpu)
+    {
+        char *parsed = nullptr;
+        errno = 0;
+        long value = std::strtol(text, &parsed, 10);
+        if (parsed == text || parsed != end || errno == ERANGE || value < 0 || value > INT_MAX)
+        {
+            return false;
+        }
+        cpu = (int)value;
+        return true;
+    }
+
+    // "0-3,8-11" -> {0,1,2,3,8,9,10,11}, malformed ranges are skipped
+    std::vector<int> parse_cpu_list(const std::string &list)
+    {
+        std::vector<int> cpus;
+        std::stringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            while (!range.empty() && std::isspace((unsigned char)range.back()))
+            {
+                range.pop_back();
+            }
+            const char *text = range.c_str();
+            const char *end = text + range.size();
+            const char *dash = std::strchr(text, '-');
+            int first = 0;
+            int last = 0;
+            if (dash ? !(parse_cpu(text, dash, first) && parse_cpu(dash + 1, end, last)) : !parse_cpu(text, end, first))
+            {
+                continue;
+            }
+            if (!dash)
+            {
+                last = first;
+            }
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // NUMA node -> CPUs, empty on systems without NUMA information
+    const std::map<int, std::vector<int>> &numa_topology()
+    {
+        static std::map<int, std::vector<int>> topology = []()
+        {
+            std::map<int, std::vector<int>> nodes;
+#if defined(__linux__)
+            for (int node = 0; node < 1024; ++node)
+            {
+                std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                if (!cpulist)
+                {
+                    if (node > 0 && nodes.empty())
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                std::string list;
+                std::getline(cpulist, list);
+                nodes[node] = parse_cpu_list(list);
+            }
+#endif
+            return nodes;
+        }();
+        return topology;
+    }
+
+    // CPUs this process may run on, what pinning round-robins over when no CPU set is configured
+    std::vector<int> available_cpus()
+    {
+        std::vector<int> cpus;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        if (cpus.empty())
+        {
+            for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+            {
+                cpus.push_back((int)cpu);
+            }
+        }
+        return cpus;
+    }
+
+    int current_cpu()
+    {
+#if defined(__linux__)
+        return sched_getcpu();
+#elif defined(_WIN32)
+        return (int)GetCurrentProcessorNumber();
+#else
+        return -1;
+#endif
+    }
+}
+
+void configure_placement(const PlacementConfig &config)
+{
+    std::lock_guard<std::mutex> lock(placementMutex);
+    placementConfig = config;
+}
+
+ContextPlacement plan_context_placement()
+{
+    PlacementConfig config;
+    {
+        std::lock_guard<std::mutex> lock(placementMutex);
+        config = placementConfig;
+    }
+
+    ContextPlacement placement;
+    placement.cpus = config.cpus;
+
+    if (config.numa)
+    {
+        placement.localHeap = true;
+        int cpu = current_cpu();
+        for (const auto &node : numa_topology())
+        {
+            if (std::find(node.second.begin(), node.second.end(), cpu) == node.second.end())
+            {
+                continue;
+            }
+            std::vector<int> nodeCpus;
+            for (int nodeCpu : node.second)
+            {
+                if (config.cpus.empty() || std::find(config.cpus.begin(), config.cpus.end(), nodeCpu) != config.cpus.end())
+                {
+                    nodeCpus.push_back(nodeCpu);
+                }
+            }
+            if (!nodeCpus.empty()) // configured CPU set doesn't cover this node, fall back to the set itself
+            {
+                placement.cpus = nodeCpus;
+            }
+            break;
+        }
+    }
+
+    if (config.pin && placement.cpus.empty())
+    {
+        placement.cpus = available_cpus();
+    }
+    if (config.pin && !placement.cpus.empty())
+    {
+        int cpu = placement.cpus[nextPinnedCpu++ % placement.cpus.size()];
+        placement.cpus = {cpu};
+    }
+    return placement;
+}
+
+void apply_context_placement(const ContextPlacement &placement)
+{
+    if (placement.cpus.empty())
+    {
+        return;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : placement.cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : placement.cpus)
+    {
+        if (cpu >= 0 && cpu < (int)(sizeof(DWORD_PTR) * 8))
+        {
+            mask |= (DWORD_PTR)1 << cpu;
+        }
+    }
+    if (mask != 0)
+    {
+        SetThreadAffinityMask(GetCurrentThread(), mask);
+    }
+#endif
+    // Other platforms (macOS) have no hard affinity API, threads stay with the OS scheduler
+}
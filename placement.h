@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+
+struct PlacementConfig
+{
+    std::vector<int> cpus; // CPUs engine threads may run on, empty means all
+    bool pin = false;      // pin every engine thread to a single CPU (round-robin) instead of the whole set
+    bool numa = false;     // keep engine threads and their heaps on the NUMA node the context was created on
+};
+
+struct ContextPlacement
+{
+    std::vector<int> cpus;  // empty leaves the thread to the OS scheduler
+    bool localHeap = false; // heap must be allocated by the engine thread itself
+};
+
+void configure_placement(const PlacementConfig &config);
+// Called on the thread creating the context, so that NUMA placement follows the creating thread's node.
+ContextPlacement plan_context_placement();
+// Called on the engine thread before it allocates its heap, so the heap is first-touched on the right node.
+void apply_context_placement(const ContextPlacement &placement);
@@ -0,0 +1,123 @@
+// Build-time tool: compiles prelude scripts to Duktape bytecode and writes them out as the embeddedPreludes table.
+// Usage: prelude_compiler <output.cpp> [prelude.js ...], a prelude is named after its file without the extension.
+// The bytecode is only loadable by the same Duktape build, which is why this links the addon's duktape.c.
+#include "duktape.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" int fatal_handler(void *udata, const char *msg); // fatal_handler.c
+
+// The addon's build of Duktape checks this from its interrupt counter (scheduler.cpp), compiling never has to yield
+extern "C" duk_bool_t glomium_exec_timeout_check(void *udata)
+{
+    return 0;
+}
+
+namespace
+{
+    struct CompileRequest
+    {
+        const std::string *source;
+        const std::string *fileName;
+    };
+
+    duk_ret_t compile_safe(duk_context *ctx, void *udata)
+    {
+        const CompileRequest *request = static_cast<const CompileRequest *>(udata);
+        duk_push_string(ctx, request->fileName->c_str());
+        duk_compile_lstring_filename(ctx, 0, request->source->c_str(), request->source->size()); // program code, like a <script>
+        duk_dump_function(ctx);
+        return 1;
+    }
+
+    std::string prelude_name(const std::string &path)
+    {
+        size_t start = path.find_last_of("/\\");
+        start = start == std::string::npos ? 0 : start + 1;
+        size_t end = path.find_last_of('.');
+        if (end == std::string::npos || end < start)
+        {
+            end = path.size();
+        }
+        return path.substr(start, end - start);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <output.cpp> [prelude.js ...]\n", argv[0]);
+        return 1;
+    }
+
+    GasData gasData;
+    gasData.gas_limit = 0x7fffffff;
+    gasData.gas_used = 0;
+    gasData.mem_cost_per_byte = 0;
+    HeapConfig heapConfig;
+    heapConfig.gasConfig = &gasData;
+    heapConfig.fatal_function = (duk_fatal_function)fatal_handler;
+    duk_context *ctx = duk_create_heap(duk_gas_respecting_alloc_function, duk_gas_respecting_realloc_function, duk_gas_respecting_free_function, &heapConfig, (duk_fatal_function)fatal_handler);
+    if (!ctx)
+    {
+        fprintf(stderr, "Failed to create Duktape context\n");
+        return 1;
+    }
+    heapConfig.ctx = (void *)ctx;
+
+    std::ostringstream output;
+    output << "// Generated by prelude_compiler, do not edit\n#include \"preludes.h\"\n\n";
+    std::vector<std::string> names;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string fileName = argv[i];
+        std::ifstream file(fileName, std::ios::binary);
+        if (!file)
+        {
+            fprintf(stderr, "Can't read prelude %s\n", fileName.c_str());
+            return 1;
+        }
+        std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        CompileRequest request{&source, &fileName};
+        gasData.gas_used = 0;
+        if (duk_safe_call(ctx, compile_safe, &request, 0, 1) != DUK_EXEC_SUCCESS)
+        {
+            fprintf(stderr, "%s: %s\n", fileName.c_str(), duk_safe_to_string(ctx, -1));
+            return 1;
+        }
+        duk_size_t size = 0;
+        const unsigned char *bytecode = static_cast<const unsigned char *>(duk_get_buffer_data(ctx, -1, &size));
+        output << "static const unsigned char prelude" << names.size() << "[] = {";
+        for (duk_size_t byte = 0; byte < size; ++byte)
+        {
+            output << (byte % 16 == 0 ? "\n    " : " ") << (unsigned)bytecode[byte] << ",";
+        }
+        output << "\n};\n\n";
+        duk_pop(ctx);
+        names.push_back(prelude_name(fileName));
+    }
+
+    output << "const EmbeddedPrelude embeddedPreludes[] = {\n";
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        output << "    {\"" << names[i] << "\", prelude" << i << ", sizeof(prelude" << i << ")},\n";
+    }
+    output << "    {nullptr, nullptr, 0},\n};\n";
+    duk_destroy_heap(ctx);
+
+    std::ofstream generated(argv[1], std::ios::binary | std::ios::trunc);
+    generated << output.str();
+    generated.close();
+    if (!generated)
+    {
+        fprintf(stderr, "Can't write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "preludes.h"
+
+namespace
+{
+    duk_ret_t install_safe(duk_context *ctx, void *udata)
+    {
+        const EmbeddedPrelude *prelude = static_cast<const EmbeddedPrelude *>(udata);
+        // Bytecode lives in the addon's read-only data, Duktape only reads from it while loading
+        duk_push_external_buffer(ctx);
+        duk_config_buffer(ctx, -1, const_cast<unsigned char *>(prelude->bytecode), prelude->size);
+        duk_load_function(ctx);
+        duk_push_global_object(ctx);
+        duk_call_method(ctx, 0);
+        return 0;
+    }
+}
+
+const EmbeddedPrelude *find_prelude(const std::string &name)
+{
+    for (const EmbeddedPrelude *prelude = embeddedPreludes; prelude->name; ++prelude)
+    {
+        if (name == prelude->name)
+        {
+            return prelude;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::string> prelude_names()
+{
+    std::vector<std::string> names;
+    for (const EmbeddedPrelude *prelude = embeddedPreludes; prelude->name; ++prelude)
+    {
+        names.push_back(prelude->name);
+    }
+    return names;
+}
+
+bool install_preludes(duk_context *ctx, const std::vector<const EmbeddedPrelude *> &preludes)
+{
+    GasData *gasData = duk_get_gas_info(ctx);
+    GasData savedGas = *gasData;
+    gasData->gas_used = 0;
+    gasData->gas_limit = 0x7fffffff;
+    bool installed = true;
+    for (const EmbeddedPrelude *prelude : preludes)
+    {
+        installed = duk_safe_call(ctx, install_safe, const_cast<EmbeddedPrelude *>(prelude), 0, 1) == DUK_EXEC_SUCCESS;
+        duk_pop(ctx);
+        if (!installed)
+        {
+            break;
+        }
+    }
+    gasData->gas_limit = savedGas.gas_limit;
+    gasData->gas_used = savedGas.gas_used;
+    return installed;
+}
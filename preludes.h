@@ -0,0 +1,20 @@
+#pragma once
+#include "duktape.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Prelude compiled to Duktape bytecode at build time (prelude_compiler), the table is generated into embedded_preludes.cpp
+struct EmbeddedPrelude
+{
+    const char *name;
+    const unsigned char *bytecode;
+    size_t size;
+};
+
+extern const EmbeddedPrelude embeddedPreludes[]; // terminated by an entry with a null name
+
+const EmbeddedPrelude *find_prelude(const std::string &name);
+std::vector<std::string> prelude_names();
+// Runs the preludes in order against ctx's global object. Preludes are setup rather than user code, so they aren't charged gas.
+bool install_preludes(duk_context *ctx, const std::vector<const EmbeddedPrelude *> &preludes);
@@ -0,0 +1,76 @@
+// ES2015/ES2016 Array additions missing from Duktape, installed as non-enumerable like the builtins
+(function () {
+    function define(target, name, value) {
+        if (!target[name]) {
+            Object.defineProperty(target, name, { value: value, writable: true, configurable: true, enumerable: false });
+        }
+    }
+    function toLength(value) {
+        var length = Math.floor(Number(value)) || 0;
+        return Math.min(Math.max(length, 0), 9007199254740991);
+    }
+    function toIndex(value, length) {
+        var index = Math.floor(Number(value)) || 0;
+        return index < 0 ? Math.max(length + index, 0) : Math.min(index, length);
+    }
+
+    define(Array.prototype, "find", function (predicate, thisArg) {
+        var list = Object(this), length = toLength(list.length);
+        for (var i = 0; i < length; i++) {
+            if (predicate.call(thisArg, list[i], i, list)) {
+                return list[i];
+            }
+        }
+        return undefined;
+    });
+    define(Array.prototype, "findIndex", function (predicate, thisArg) {
+        var list = Object(this), length = toLength(list.length);
+        for (var i = 0; i < length; i++) {
+            if (predicate.call(thisArg, list[i], i, list)) {
+                return i;
+            }
+        }
+        return -1;
+    });
+    define(Array.prototype, "includes", function (searchElement, fromIndex) {
+        var list = Object(this), length = toLength(list.length);
+        for (var i = toIndex(fromIndex, length); i < length; i++) {
+            var element = list[i];
+            if (element === searchElement || (element !== element && searchElement !== searchElement)) {
+                return true;
+            }
+        }
+        return false;
+    });
+    define(Array.prototype, "fill", function (value, start, end) {
+        var list = Object(this), length = toLength(list.length);
+        var last = end === undefined ? length : toIndex(end, length);
+        for (var i = toIndex(start, length); i < last; i++) {
+            list[i] = value;
+        }
+        return list;
+    });
+    define(Array, "of", function () {
+        return Array.prototype.slice.call(arguments);
+    });
+    define(Array, "from", function (items, mapFn, thisArg) {
+        var source = Object(items), result = [];
+        if (typeof Symbol === "function" && Symbol.iterator && typeof source[Symbol.iterator] === "function") {
+            var iterator = source[Symbol.iterator](), step;
+            while (!(step = iterator.next()).done) {
+                result.push(step.value);
+            }
+        } else {
+            var length = toLength(source.length);
+            for (var i = 0; i < length; i++) {
+                result.push(source[i]);
+            }
+        }
+        if (mapFn) {
+            for (var j = 0; j < result.length; j++) {
+                result[j] = mapFn.call(thisArg, result[j], j);
+            }
+        }
+        return result;
+    });
+})();
@@ -0,0 +1,39 @@
+#include "profile.h"
+
+namespace
+{
+    duk_ret_t apply_global_profile_safe(duk_context *ctx, void *udata)
+    {
+        const GlobalProfile *profile = static_cast<const GlobalProfile *>(udata);
+        duk_push_bare_object(ctx);
+        duk_push_global_object(ctx);
+        for (const auto &name : profile->globals)
+        {
+            if (name == "globalThis")
+            {
+                duk_dup(ctx, -2);
+            }
+            else if (!duk_get_prop_string(ctx, -1, name.c_str()))
+            {
+                duk_pop(ctx);
+                continue;
+            }
+            duk_put_prop_string(ctx, -3, name.c_str());
+        }
+        duk_pop(ctx);
+        duk_set_global_object(ctx);
+        return 0;
+    }
+}
+
+bool apply_global_profile(duk_context *ctx, const GlobalProfile &profile)
+{
+    if (profile.full)
+    {
+        return true;
+    }
+    // The old global is left to the regular GC, forcing a collection here would only slow every heap setup down
+    bool applied = duk_safe_call(ctx, apply_global_profile_safe, (void *)&profile, 0, 1) == DUK_EXEC_SUCCESS;
+    duk_pop(ctx);
+    return applied;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "duktape.h"
+#include <string>
+#include <vector>
+
+struct GlobalProfile
+{
+    bool full = true;                 // keep the global object Duktape built
+    std::vector<std::string> globals; // otherwise only these of its bindings move to a bare global, "bare" is empty
+};
+
+// Swaps the global object of ctx for a bare one with only the profile's bindings. This hides names, nothing more:
+// the heap was built with every builtin before, and they stay reachable from the captured intrinsics and from
+// literals ({}.constructor, (function(){}).constructor, ...). A profile neither speeds up heap creation nor saves
+// memory worth mentioning. Returns false (leaving the global as it was) if the swap failed.
+bool apply_global_profile(duk_context *ctx, const GlobalProfile &profile);
@@ -0,0 +1,149 @@
+#include "realms.h"
+#include "descriptors.h"
+#include "intrinsics.h"
+
+namespace
+{
+    const char *RealmsStashKey = "glomiumRealms";
+    const char *RealmGlobalsStashKey = "glomiumRealmGlobals";
+    const duk_uint_t AllOwnKeys = DUK_ENUM_OWN_PROPERTIES_ONLY | DUK_ENUM_INCLUDE_NONENUMERABLE | DUK_ENUM_INCLUDE_SYMBOLS | DUK_ENUM_NO_PROXY_BEHAVIOR;
+
+    // [ ... ] -> [ ... realms ]
+    void push_realms(duk_context *ctx)
+    {
+        duk_push_heap_stash(ctx);
+        if (!duk_get_prop_string(ctx, -1, RealmsStashKey))
+        {
+            duk_pop(ctx);
+            duk_push_bare_object(ctx);
+            duk_push_uint(ctx, 0);
+            duk_put_prop_string(ctx, -2, "count");
+            duk_dup_top(ctx);
+            duk_put_prop_string(ctx, -3, RealmsStashKey);
+        }
+        duk_remove(ctx, -2);
+    }
+
+    // [ ... ] -> [ ... id ]
+    uint32_t next_realm_id(duk_context *ctx)
+    {
+        push_realms(ctx);
+        duk_get_prop_string(ctx, -1, "count");
+        uint32_t id = duk_get_uint(ctx, -1) + 1;
+        duk_pop(ctx);
+        duk_push_uint(ctx, id);
+        duk_put_prop_string(ctx, -2, "count");
+        duk_pop(ctx);
+        return id;
+    }
+
+    duk_ret_t record_realm_globals_safe(duk_context *ctx, void *udata)
+    {
+        (void)udata;
+        duk_push_thread_stash(ctx, ctx);
+        duk_push_bare_object(ctx);
+        duk_push_global_object(ctx);
+        duk_enum(ctx, -1, AllOwnKeys);
+        while (duk_next(ctx, -1, false))
+        {
+            duk_dup(ctx, -1);
+            push_own_descriptor(ctx, -4);
+            duk_put_prop(ctx, -5);
+        }
+        duk_pop_2(ctx); // enum, global
+        duk_put_prop_string(ctx, -2, RealmGlobalsStashKey);
+        duk_pop(ctx);
+        return 0;
+    }
+
+    // Runs on the new realm thread, parent is the context the globals were recorded on
+    duk_ret_t set_up_shared_realm_safe(duk_context *realm, void *udata)
+    {
+        duk_context *parent = static_cast<duk_context *>(udata);
+        duk_push_global_object(realm); // still the parent's, the thread was created without a global environment of its own
+        duk_idx_t oldGlobal = duk_get_top(realm) - 1;
+        duk_push_object(realm);
+        duk_idx_t global = duk_get_top(realm) - 1;
+
+        duk_push_thread_stash(realm, parent);
+        duk_get_prop_string(realm, -1, RealmGlobalsStashKey);
+        duk_enum(realm, -1, AllOwnKeys);
+        while (duk_next(realm, -1, true))
+        {
+            duk_idx_t desc = duk_get_top(realm) - 1;
+            duk_get_prop_string(realm, desc, "value");
+            if (duk_strict_equals(realm, -1, oldGlobal))
+            {
+                duk_dup(realm, global);
+                duk_put_prop_string(realm, desc, "value");
+            }
+            duk_pop(realm);
+            duk_dup(realm, -2);
+            define_from_descriptor(realm, global, desc);
+            duk_pop_2(realm);
+        }
+        duk_pop_3(realm); // enum, globals, stash
+
+        duk_dup(realm, global);
+        duk_set_global_object(realm);
+        duk_pop_2(realm);
+        capture_intrinsics(realm); // same objects as the parent's, reached through the copied bindings
+        return 0;
+    }
+}
+
+uint32_t create_realm(duk_context *ctx)
+{
+    uint32_t id = next_realm_id(ctx);
+    push_realms(ctx);
+    duk_push_thread_new_globalenv(ctx);
+    duk_put_prop_index(ctx, -2, id);
+    duk_pop(ctx);
+    return id;
+}
+
+bool record_realm_globals(duk_context *ctx)
+{
+    bool recorded = duk_safe_call(ctx, record_realm_globals_safe, nullptr, 0, 1) == DUK_EXEC_SUCCESS;
+    duk_pop(ctx);
+    return recorded;
+}
+
+uint32_t create_shared_realm(duk_context *ctx)
+{
+    uint32_t id = next_realm_id(ctx);
+    push_realms(ctx);
+    duk_push_thread(ctx);
+    duk_context *realm = duk_get_context(ctx, -1);
+    bool created = duk_safe_call(realm, set_up_shared_realm_safe, ctx, 0, 1) == DUK_EXEC_SUCCESS;
+    duk_pop(realm);
+    if (created)
+    {
+        duk_put_prop_index(ctx, -2, id);
+    }
+    else
+    {
+        duk_pop(ctx);
+    }
+    duk_pop(ctx);
+    return created ? id : 0;
+}
+
+duk_context *get_realm_context(duk_context *ctx, uint32_t id)
+{
+    push_realms(ctx);
+    duk_context *realm = nullptr;
+    if (duk_get_prop_index(ctx, -1, id))
+    {
+        realm = duk_get_context(ctx, -1);
+    }
+    duk_pop_2(ctx);
+    return realm;
+}
+
+void dispose_realm(duk_context *ctx, uint32_t id)
+{
+    push_realms(ctx);
+    duk_del_prop_index(ctx, -1, id);
+    duk_pop(ctx);
+}
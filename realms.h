@@ -0,0 +1,17 @@
+#pragma once
+#include "duktape.h"
+#include <cstdint>
+
+// A realm is a Duktape thread with its own global environment, living in the heap of the context that created it.
+// Realms are kept reachable from the heap stash until disposed or until the heap goes away.
+// create_realm() gives the realm its own copy of every builtin.
+uint32_t create_realm(duk_context *ctx);
+// Records the global bindings of ctx that shared realms start from, call it before the profile hides any of them.
+bool record_realm_globals(duk_context *ctx);
+// Realm whose thread shares the builtins of ctx, only its global object is new. Its bindings are those recorded by
+// record_realm_globals(), with the old global's self references (globalThis) pointing to the new one. The builtins
+// have to be locked down first, realms would otherwise see each other's changes. Returns 0 on failure.
+uint32_t create_shared_realm(duk_context *ctx);
+// Context of the realm's thread, nullptr if the id is unknown. Valid until dispose_realm or heap destruction.
+duk_context *get_realm_context(duk_context *ctx, uint32_t id);
+void dispose_realm(duk_context *ctx, uint32_t id);
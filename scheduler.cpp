@@ -0,0 +1,133 @@
+#include "scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace
+{
+    struct SlotState
+    {
+        bool holding = false;
+        std::chrono::steady_clock::time_point sliceStart;
+    };
+
+    std::mutex poolMutex;
+    std::condition_variable poolCv;
+    ExecutionPoolConfig poolConfig;
+    uint32_t runningSlots = 0;
+    uint64_t nextTicket = 0;
+    std::deque<uint64_t> waitingTickets; // FIFO, a preempted context goes to the back so every context gets its turn
+
+    std::atomic<bool> poolEnabled{false};
+    std::atomic<uint32_t> waitingCount{0};
+    std::atomic<int64_t> sliceNs{10 * 1000 * 1000};
+
+    struct GasStop
+    {
+        const GasData *gas = nullptr;
+        uint64_t limit = 0;
+    };
+
+    thread_local SlotState slotState;
+    thread_local GasStop gasStop;
+}
+
+bool execution_preemption_available()
+{
+#if defined(DUK_USE_EXEC_TIMEOUT_CHECK)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void configure_execution_pool(const ExecutionPoolConfig &config)
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        poolConfig = config;
+        sliceNs = static_cast<int64_t>(config.sliceMs) * 1000 * 1000;
+        poolEnabled = config.workers != 0;
+    }
+    poolCv.notify_all();
+}
+
+IdlePolicy default_idle_policy()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return poolConfig.idle;
+}
+
+void acquire_execution_slot()
+{
+    slotState.sliceStart = std::chrono::steady_clock::now();
+    if (!poolEnabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        uint64_t ticket = nextTicket++;
+        waitingTickets.push_back(ticket);
+        waitingCount++;
+        poolCv.wait(lock, [ticket]()
+                    { return waitingTickets.front() == ticket && (poolConfig.workers == 0 || runningSlots < poolConfig.workers); });
+        waitingTickets.pop_front();
+        waitingCount--;
+        runningSlots++;
+        slotState.holding = true;
+    }
+    poolCv.notify_all(); // next ticket in line may be admissible too
+
+    slotState.sliceStart = std::chrono::steady_clock::now();
+}
+
+void release_execution_slot()
+{
+    if (!slotState.holding)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        runningSlots--;
+        slotState.holding = false;
+    }
+    poolCv.notify_all();
+}
+
+void set_gas_stop(const GasData *gas, uint64_t limit)
+{
+    gasStop.gas = gas;
+    gasStop.limit = limit;
+}
+
+void clear_gas_stop()
+{
+    gasStop.gas = nullptr;
+}
+
+extern "C" duk_bool_t glomium_exec_timeout_check(void *udata)
+{
+    (void)udata;
+    if (gasStop.gas && gasStop.gas->gas_used > gasStop.limit)
+    {
+        return 1;
+    }
+    if (!slotState.holding || waitingCount.load(std::memory_order_relaxed) == 0)
+    {
+        return 0;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - slotState.sliceStart;
+    if (std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() < sliceNs.load(std::memory_order_relaxed))
+    {
+        return 0;
+    }
+    // Duktape call state stays parked on this thread's stack until the context is readmitted
+    release_execution_slot();
+    acquire_execution_slot();
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "duktape.h"
+#include <cstdint>
+
+struct IdlePolicy
+{
+    uint32_t spinUs = 0;   // busy-poll the queue this long once it runs empty
+    uint32_t yieldUs = 0;  // then keep yielding the CPU this long before parking on the condition variable
+    bool adaptive = false; // park right away while messages usually arrive later than spinUs + yieldUs
+};
+
+struct ExecutionPoolConfig
+{
+    uint32_t workers = 0; // 0 disables admission control, every context runs as soon as its thread is ready
+    uint32_t sliceMs = 10;
+    IdlePolicy idle; // default for contexts that don't set their own
+};
+
+// Whether Duktape was configured with DUK_USE_EXEC_TIMEOUT_CHECK. Without the hook a running context is never
+// preempted, so a pool with workers would let one long call starve everyone else.
+bool execution_preemption_available();
+void configure_execution_pool(const ExecutionPoolConfig &config);
+IdlePolicy default_idle_policy();
+void acquire_execution_slot();
+void release_execution_slot();
+
+// Makes the executor interrupt stop the running call once gas->gas_used passes limit. Duktape throws a RangeError there
+// and keeps throwing at every instruction until the call unwinds to the outermost pcall, so guest catch blocks can't
+// swallow it. Lets a call stop short of the fatal gas limit while its heap is still usable. Engine thread only.
+void set_gas_stop(const GasData *gas, uint64_t limit);
+void clear_gas_stop();
+
+// Called by Duktape from the executor interrupt (DUK_USE_EXEC_TIMEOUT_CHECK), the same boundary gas is checked at.
+// Aborts execution only for a gas stop, otherwise it hands the slot over when the slice is spent, so results stay
+// deterministic.
+extern "C" duk_bool_t glomium_exec_timeout_check(void *udata);
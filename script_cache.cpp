@@ -0,0 +1,275 @@
+#include "script_cache.h"
+#include "bytecode_store.h"
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+    struct StoredScript
+    {
+        std::shared_ptr<const CompiledScript> script;
+        size_t retainCount = 0;
+        std::list<std::string>::iterator recent; // position in recentScripts
+    };
+
+    std::mutex scriptStoreMutex;
+    std::unordered_map<std::string, StoredScript> scriptStore;
+    std::list<std::string> recentScripts; // most recently used first
+    ScriptCacheConfig scriptCacheConfig;
+    ScriptCacheStats scriptCacheCounters;
+
+    std::string hash_source(const std::string &source)
+    {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        for (unsigned char c : source)
+        {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return std::string(hex);
+    }
+
+    uint64_t stored_size(const CompiledScript &script)
+    {
+        return script.source.size() + script.bytecode.size();
+    }
+
+    duk_ret_t compile_safe(duk_context *ctx, void *udata)
+    {
+        const std::string *source = static_cast<const std::string *>(udata);
+        duk_compile_lstring(ctx, DUK_COMPILE_EVAL, source->c_str(), source->size());
+        duk_dup(ctx, -1);
+        duk_dump_function(ctx);
+        return 2; // [ function bytecode ]
+    }
+
+    duk_ret_t compile_only_safe(duk_context *ctx, void *udata)
+    {
+        const std::string *source = static_cast<const std::string *>(udata);
+        duk_compile_lstring(ctx, DUK_COMPILE_EVAL, source->c_str(), source->size());
+        return 1;
+    }
+
+    duk_ret_t load_safe(duk_context *ctx, void *udata)
+    {
+        const CompiledScript *script = static_cast<const CompiledScript *>(udata);
+        // Duktape copies everything it needs out of the buffer, it doesn't have to outlive the load
+        duk_push_external_buffer(ctx);
+        duk_config_buffer(ctx, -1, const_cast<char *>(script->bytecode.data()), script->bytecode.size());
+        duk_load_function(ctx);
+        return 1;
+    }
+
+    // Scripts with the same hash get "-1", "-2", ... suffixes, lookups compare the source
+    StoredScript *find_by_source_locked(const std::string &key, const std::string &source, std::string &id)
+    {
+        for (size_t collision = 0;; ++collision)
+        {
+            id = collision == 0 ? key : key + "-" + std::to_string(collision);
+            auto it = scriptStore.find(id);
+            if (it == scriptStore.end())
+            {
+                return nullptr;
+            }
+            if (it->second.script->source == source)
+            {
+                return &it->second;
+            }
+        }
+    }
+
+    void touch_locked(StoredScript &stored)
+    {
+        recentScripts.splice(recentScripts.begin(), recentScripts, stored.recent);
+    }
+
+    void erase_locked(std::unordered_map<std::string, StoredScript>::iterator it)
+    {
+        scriptCacheCounters.bytes -= stored_size(*it->second.script);
+        recentScripts.erase(it->second.recent);
+        scriptStore.erase(it);
+    }
+
+    // Least recently used unretained scripts go first
+    void trim_locked()
+    {
+        auto recent = recentScripts.end();
+        while (scriptCacheCounters.bytes > scriptCacheConfig.maxBytes && recent != recentScripts.begin())
+        {
+            --recent;
+            auto it = scriptStore.find(*recent);
+            if (it->second.retainCount != 0)
+            {
+                continue;
+            }
+            recent = std::next(recent);
+            erase_locked(it);
+            scriptCacheCounters.evictions++;
+        }
+    }
+
+    std::string store_locked(const std::string &source, const std::string &key, const char *bytecode, size_t bytecodeSize, size_t retainCount)
+    {
+        std::string id;
+        StoredScript *stored = find_by_source_locked(key, source, id);
+        if (stored)
+        {
+            stored->retainCount += retainCount; // another heap compiled it meanwhile
+        }
+        else
+        {
+            auto script = std::make_shared<CompiledScript>();
+            script->id = id;
+            script->source = source;
+            script->bytecode.assign(bytecode, bytecodeSize);
+            recentScripts.push_front(id);
+            scriptStore[id] = StoredScript{script, retainCount, recentScripts.begin()};
+            scriptCacheCounters.bytes += stored_size(*script);
+            trim_locked();
+        }
+        return id;
+    }
+
+    // [ ... function bytecode ] -> [ ... function ]
+    std::string store_compiled_locked(duk_context *ctx, const std::string &source, const std::string &key, size_t retainCount)
+    {
+        duk_size_t bytecodeSize = 0;
+        const char *bytecode = static_cast<const char *>(duk_get_buffer_data(ctx, -1, &bytecodeSize));
+        std::string id = store_locked(source, key, bytecode, bytecodeSize, retainCount);
+        duk_pop(ctx);
+        return id;
+    }
+}
+
+bool compile_and_store_script(duk_context *ctx, const std::string &source, std::string &id)
+{
+    if (duk_safe_call(ctx, compile_safe, const_cast<std::string *>(&source), 0, 2) != DUK_EXEC_SUCCESS)
+    {
+        duk_pop(ctx); // safe_call leaves [ error undefined ]
+        return false;
+    }
+
+    std::string key = hash_source(source);
+    std::lock_guard<std::mutex> lock(scriptStoreMutex);
+    id = store_compiled_locked(ctx, source, key, 1);
+    return true;
+}
+
+std::shared_ptr<const CompiledScript> find_compiled_script(const std::string &id)
+{
+    std::lock_guard<std::mutex> lock(scriptStoreMutex);
+    auto it = scriptStore.find(id);
+    if (it == scriptStore.end())
+    {
+        return nullptr;
+    }
+    touch_locked(it->second);
+    return it->second.script;
+}
+
+void release_compiled_script(const std::string &id)
+{
+    std::lock_guard<std::mutex> lock(scriptStoreMutex);
+    auto it = scriptStore.find(id);
+    if (it != scriptStore.end() && --it->second.retainCount == 0)
+    {
+        trim_locked();
+    }
+}
+
+bool push_compiled_script(duk_context *ctx, const CompiledScript &script)
+{
+    return duk_safe_call(ctx, load_safe, const_cast<CompiledScript *>(&script), 0, 1) == DUK_EXEC_SUCCESS;
+}
+
+bool push_cached_script(duk_context *ctx, const std::string &source)
+{
+    std::string key = hash_source(source);
+    std::shared_ptr<const CompiledScript> script;
+    bool caching;
+    {
+        std::lock_guard<std::mutex> lock(scriptStoreMutex);
+        std::string id;
+        StoredScript *stored = find_by_source_locked(key, source, id);
+        if (stored)
+        {
+            scriptCacheCounters.hits++;
+            touch_locked(*stored);
+            script = stored->script;
+        }
+        else
+        {
+            scriptCacheCounters.misses++;
+        }
+        caching = scriptCacheConfig.maxBytes != 0;
+    }
+
+    if (script)
+    {
+        return push_compiled_script(ctx, *script);
+    }
+
+    bool persisting = bytecode_store_enabled();
+    std::string bytecode;
+    if (persisting && load_stored_script(ctx, key, source, bytecode))
+    {
+        std::lock_guard<std::mutex> lock(scriptStoreMutex);
+        scriptCacheCounters.diskHits++;
+        if (caching)
+        {
+            store_locked(source, key, bytecode.data(), bytecode.size(), 0);
+        }
+        return true;
+    }
+    if (!caching && !persisting)
+    {
+        return duk_safe_call(ctx, compile_only_safe, const_cast<std::string *>(&source), 0, 1) == DUK_EXEC_SUCCESS;
+    }
+    if (duk_safe_call(ctx, compile_safe, const_cast<std::string *>(&source), 0, 2) != DUK_EXEC_SUCCESS)
+    {
+        duk_pop(ctx);
+        return false;
+    }
+    bool written = false;
+    if (persisting)
+    {
+        duk_size_t bytecodeSize = 0;
+        const char *dumped = static_cast<const char *>(duk_get_buffer_data(ctx, -1, &bytecodeSize));
+        written = store_script(key, source, dumped, bytecodeSize);
+    }
+    std::lock_guard<std::mutex> lock(scriptStoreMutex);
+    if (written)
+    {
+        scriptCacheCounters.diskWrites++;
+    }
+    if (caching)
+    {
+        store_compiled_locked(ctx, source, key, 0);
+    }
+    else
+    {
+        duk_pop(ctx);
+    }
+    return true;
+}
+
+void configure_script_cache(const ScriptCacheConfig &config)
+{
+    configure_bytecode_store(config.directory); // may prune the directory, lookups don't wait for that
+    std::lock_guard<std::mutex> lock(scriptStoreMutex);
+    scriptCacheConfig = config;
+    trim_locked();
+}
+
+ScriptCacheStats script_cache_stats()
+{
+    std::lock_guard<std::mutex> lock(scriptStoreMutex);
+    ScriptCacheStats stats = scriptCacheCounters;
+    stats.entries = (uint32_t)scriptStore.size();
+    return stats;
+}
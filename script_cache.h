@@ -0,0 +1,44 @@
+#pragma once
+#include "duktape.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct CompiledScript
+{
+    std::string id;
+    std::string source;
+    std::string bytecode; // duk_dump_function output, loadable into any heap of this build
+};
+
+struct ScriptCacheConfig
+{
+    uint64_t maxBytes = 0; // source plus bytecode of unretained scripts kept for run(), 0 disables caching them
+    std::string directory; // on-disk store behind the in-memory cache, empty disables it
+};
+
+struct ScriptCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t diskHits = 0;   // in-memory misses loaded from the on-disk store
+    uint64_t diskWrites = 0;
+    uint64_t bytes = 0; // retained scripts included
+    uint32_t entries = 0;
+};
+
+// Compiles source as eval code (so calling it yields the completion value) and stores its bytecode.
+// On success leaves the compiled function on the stack, on failure the error, returns false.
+// Every successful call retains the stored script once, pair with release_compiled_script().
+// Retained scripts are never evicted, once released they stay cached like any other.
+bool compile_and_store_script(duk_context *ctx, const std::string &source, std::string &id);
+std::shared_ptr<const CompiledScript> find_compiled_script(const std::string &id);
+void release_compiled_script(const std::string &id);
+// Pushes a fresh function loaded from the bytecode, or the load error, returns false on error.
+bool push_compiled_script(duk_context *ctx, const CompiledScript &script);
+// Same function duk_compile would give for source, loaded from the cache shared by all heaps when the source
+// was seen before, compiled and cached otherwise. On failure pushes the error and returns false.
+bool push_cached_script(duk_context *ctx, const std::string &source);
+void configure_script_cache(const ScriptCacheConfig &config);
+ScriptCacheStats script_cache_stats();
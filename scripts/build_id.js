@@ -0,0 +1,12 @@
+// Writes the translation unit holding the Duktape build id: a hash over the Duktape sources and config the addon is
+// compiled with. Bytecode is only portable between builds with the same id, so the on-disk bytecode store keys its
+// files by it. Usage: node scripts/build_id.js <output.cpp> <file>...
+const { createHash } = require("crypto");
+const fs = require("fs");
+
+const [output, ...inputs] = process.argv.slice(2);
+const hash = createHash("sha256");
+for (const input of inputs) {
+    hash.update(fs.readFileSync(input));
+}
+fs.writeFileSync(output, `// Generated by scripts/build_id.js, do not edit\nextern const char *const glomiumDuktapeBuildId = "${hash.digest("hex")}";\n`);
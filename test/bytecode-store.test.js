@@ -0,0 +1,77 @@
+// On-disk bytecode store: damaged or foreign files are never loaded, they are replaced by a fresh compile
+const test = require("node:test")
+const assert = require("node:assert")
+const fs = require("fs")
+const os = require("os")
+const path = require("path")
+const Glomium = require("..")
+
+const HEADER_BYTES = 48 // StoredScriptHeader: magic, format version, Duktape version, reserved, build hash, sizes, checksum
+const directory = fs.mkdtempSync(path.join(os.tmpdir(), "glomium-store-test-"))
+// No in-memory cache, so every run() goes to the store
+Glomium.configurePool({ scriptCache: { maxBytes: 0, directory } })
+test.after(() => fs.rmSync(directory, { recursive: true, force: true }))
+
+function storedFiles() {
+    return fs.readdirSync(directory).filter(name => name.endsWith(".glbc"))
+}
+
+function diskStats() {
+    const { diskHits, diskWrites } = Glomium.getStats().scriptCache
+    return { diskHits, diskWrites }
+}
+
+// Stores code, damages its file with mutate, then checks the next run compiles again and rewrites a loadable file
+async function checkRecovers(name, mutate) {
+    const vm = new Glomium()
+    const code = `var total = 0; for (var i = 0; i < 10; i++) total += i; total // ${name}`
+    const before = new Set(storedFiles())
+    assert.strictEqual(await vm.run(code), 45)
+    const [file] = storedFiles().filter(name => !before.has(name))
+    assert.ok(file, "script was stored")
+    const filePath = path.join(directory, file)
+    mutate(filePath)
+
+    const damaged = diskStats()
+    assert.strictEqual(await vm.run(code), 45)
+    const recompiled = diskStats()
+    assert.strictEqual(recompiled.diskHits, damaged.diskHits)
+    assert.strictEqual(recompiled.diskWrites, damaged.diskWrites + 1)
+
+    assert.strictEqual(await vm.run(code), 45)
+    assert.strictEqual(diskStats().diskHits, recompiled.diskHits + 1)
+    await vm.dispose()
+}
+
+test("a truncated file is recompiled", () => checkRecovers("truncated", file => {
+    fs.truncateSync(file, fs.statSync(file).size - 7)
+}))
+
+test("a file with a flipped bytecode byte is recompiled", () => checkRecovers("flipped", file => {
+    const data = fs.readFileSync(file)
+    data[HEADER_BYTES + 3] ^= 0xff
+    fs.writeFileSync(file, data)
+}))
+
+test("a file with another format version is recompiled", () => checkRecovers("version", file => {
+    const data = fs.readFileSync(file)
+    data.writeUInt32LE(data.readUInt32LE(4) + 1, 4)
+    fs.writeFileSync(file, data)
+}))
+
+test("files of other builds and stale temporary files are pruned", async () => {
+    const foreign = path.join(directory, "0123456789abcdef-00000000deadbeef.glbc")
+    const stale = path.join(directory, "0123456789abcdef-00000000deadbeef.glbc.tmp1-2")
+    const fresh = path.join(directory, "0123456789abcdef-00000000deadbeef.glbc.tmp3-4")
+    for (const file of [foreign, stale, fresh]) {
+        fs.writeFileSync(file, "x")
+    }
+    const hourAgo = new Date(Date.now() - 60 * 60 * 1000)
+    fs.utimesSync(stale, hourAgo, hourAgo)
+
+    Glomium.configurePool({ scriptCache: { directory: "" } })
+    Glomium.configurePool({ scriptCache: { directory } })
+    assert.ok(!fs.existsSync(foreign))
+    assert.ok(!fs.existsSync(stale))
+    assert.ok(fs.existsSync(fresh))
+})
@@ -0,0 +1,58 @@
+// set() copies Node values into the guest natively, get() brings buffers back as views of the same kind
+const test = require("node:test")
+const assert = require("node:assert")
+const Glomium = require("..")
+
+test("buffers round-trip through set and get", async () => {
+    const vm = new Glomium()
+    const buffer = Buffer.from("glomium")
+    await vm.set("buffer", buffer)
+    const bufferBack = await vm.get("buffer")
+    assert.ok(bufferBack instanceof Uint8Array)
+    assert.deepStrictEqual(Buffer.from(bufferBack), buffer)
+
+    // Only the viewed elements are copied, not the whole backing store
+    const backing = new Float64Array([0.5, 1.5, -2.25, Math.PI, 1e300, NaN])
+    const floats = backing.subarray(2, 5)
+    assert.strictEqual(floats.byteOffset, 16)
+    await vm.set("floats", floats)
+    assert.deepStrictEqual(await vm.run("[floats.length, floats[0], floats instanceof Float64Array]"), [3, -2.25, true])
+    const floatsBack = await vm.get("floats")
+    assert.ok(floatsBack instanceof Float64Array)
+    assert.deepStrictEqual(Array.from(floatsBack), [-2.25, Math.PI, 1e300])
+
+    const view = new DataView(new ArrayBuffer(12), 4, 6)
+    view.setUint16(0, 0xbeef)
+    view.setInt32(2, -7)
+    await vm.set("view", view)
+    assert.strictEqual(await vm.run("view.byteLength + ':' + view.getUint16(0)"), "6:" + 0xbeef)
+    const viewBack = await vm.get("view")
+    assert.ok(viewBack instanceof DataView)
+    assert.strictEqual(viewBack.byteLength, 6)
+    assert.strictEqual(viewBack.getUint16(0), 0xbeef)
+    assert.strictEqual(viewBack.getInt32(2), -7)
+
+    // Nested in an object and written by the guest
+    await vm.set("state", { bytes: new Uint8Array([1, 2, 3]) })
+    await vm.run("state.bytes[0] = 9")
+    const state = await vm.get("state")
+    assert.deepStrictEqual(Array.from(state.bytes), [9, 2, 3])
+    await vm.dispose()
+})
+
+test("a cyclic object rejects with a RangeError", async () => {
+    const vm = new Glomium()
+    const cyclic = { name: "loop" }
+    cyclic.self = cyclic
+    await assert.rejects(vm.set("cyclic", cyclic), RangeError)
+    const list = []
+    list.push(list)
+    await assert.rejects(vm.set("list", list), RangeError)
+    await assert.rejects(vm.call(await vm.run("(function (value) { return 1 })"), [cyclic]), RangeError)
+
+    // Nothing was set and the instance keeps working
+    assert.strictEqual(await vm.run("typeof cyclic"), "undefined")
+    await vm.set("fine", { name: "ok" })
+    assert.deepStrictEqual(await vm.get("fine"), { name: "ok" })
+    await vm.dispose()
+})
@@ -0,0 +1,58 @@
+// Object handles and prepared scripts pin guest values until they are released
+const test = require("node:test")
+const assert = require("node:assert")
+const Glomium = require("..")
+
+test("a handle converts only the path it is asked for", async () => {
+    const vm = new Glomium()
+    const ledger = await vm.run("({ accounts: [{ balance: 5 }, { balance: 7 }] })", { result: "handle" })
+    assert.strictEqual(await ledger.get("accounts.1.balance"), 7)
+    assert.deepStrictEqual(await ledger.keys("accounts"), ["0", "1"])
+    await vm.dispose()
+})
+
+test("a released handle no longer reaches its object", async () => {
+    const vm = new Glomium()
+    const ledger = await vm.run("({ total: 3 })", { result: "handle" })
+    ledger.release()
+    await new Promise(res => setTimeout(res, 20))
+    await assert.rejects(vm.__passToEngine({ event: "handleGet", handle: ledger.handle, path: [] }))
+    await vm.dispose()
+})
+
+test("a released prepared script can't be called", async () => {
+    const vm = new Glomium()
+    const script = await vm.compile("(function (a, b) { return a + b })")
+    assert.strictEqual(await script.call([1, 2]), 3)
+    script.release()
+    await new Promise(res => setTimeout(res, 20))
+    await assert.rejects(script.call([1, 2]))
+    await vm.dispose()
+})
+
+test("a prepared script that throws reports the guest error", async () => {
+    const vm = new Glomium()
+    const script = await vm.compile("(function () { throw new Error('boom') })")
+    await assert.rejects(script.call([]), /boom/)
+    await vm.dispose()
+})
+
+test("handles don't survive a full clear", async () => {
+    const vm = new Glomium()
+    const ledger = await vm.run("({ total: 3 })", { result: "handle" })
+    await vm.clear()
+    await assert.rejects(ledger.get("total"))
+    await vm.dispose()
+})
+
+test("disposing a realm releases the handles it returned", async () => {
+    const vm = new Glomium()
+    const realm = await vm.createRealm()
+    const ledger = await realm.run("({ total: 3 })", { result: "handle" })
+    const script = await realm.compile("(function () { return 1 })")
+    assert.strictEqual(await ledger.get("total"), 3)
+    await realm.dispose()
+    await assert.rejects(vm.__passToEngine({ event: "handleGet", handle: ledger.handle, path: [] }))
+    await assert.rejects(vm.__callHandle(script.handle, []))
+    await vm.dispose()
+})
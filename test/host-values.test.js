@@ -0,0 +1,48 @@
+// Host functions passed to the engine are let go once the guest can't reach them, including calls that never ran
+const test = require("node:test")
+const assert = require("node:assert")
+const Glomium = require("..")
+
+async function settled(vm) {
+    for (let i = 0; i < 50 && vm.functionRegistry.size > 0; i++) {
+        global.gc?.()
+        await new Promise(res => setTimeout(res, 20))
+    }
+    return vm.functionRegistry.size
+}
+
+test("a host function kept by the guest stays registered", async () => {
+    const vm = new Glomium()
+    await vm.set("callback", () => 42)
+    assert.strictEqual(await vm.run("callback()"), 42)
+    assert.strictEqual(vm.functionRegistry.size, 1)
+    await vm.dispose()
+})
+
+test("a call rejected before it runs lets go of its host functions", async () => {
+    const vm = new Glomium()
+    const script = await vm.compile("(function (f) { return f() })")
+    script.release()
+    await new Promise(res => setTimeout(res, 20))
+    await assert.rejects(script.call([() => 1]))
+    assert.strictEqual(await settled(vm), 0)
+    await vm.dispose()
+})
+
+test("calls to a disposed realm let go of their host functions", async () => {
+    const vm = new Glomium()
+    const realm = await vm.createRealm()
+    await realm.dispose()
+    await assert.rejects(realm.set("callback", () => 1))
+    assert.strictEqual(await settled(vm), 0)
+    await vm.dispose()
+})
+
+test("a call that fails to encode lets go of the host functions it already collected", async () => {
+    const vm = new Glomium()
+    const cyclic = { callback: () => 1 }
+    cyclic.self = cyclic
+    await assert.rejects(vm.set("value", cyclic))
+    assert.strictEqual(vm.functionRegistry.size, 0)
+    await vm.dispose()
+})
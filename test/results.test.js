@@ -0,0 +1,80 @@
+// Result modes of run() and call(): whole conversion, discard, pick and handle, plus per-call onStats
+const test = require("node:test")
+const assert = require("node:assert")
+const Glomium = require("..")
+
+const ACCOUNT = "({ balance: 10, nonce: 3, owner: { name: 'a', tags: ['x', 'y'] }, history: [1, 2, 3] })"
+
+test("pick converts only the listed paths", async () => {
+    const vm = new Glomium()
+    assert.deepStrictEqual(await vm.run(ACCOUNT, { result: { pick: ["balance", "nonce"] } }), { balance: 10, nonce: 3 })
+    assert.deepStrictEqual(await vm.run(ACCOUNT, { result: { pick: ["owner.name", ["owner", "tags", 1]] } }), { owner: { name: "a", tags: { 1: "y" } } })
+    await vm.dispose()
+})
+
+test("pick leaves out paths that can't be read", async () => {
+    const vm = new Glomium()
+    const code = "({ balance: 1, get broken() { throw new Error('no') } })"
+    assert.deepStrictEqual(await vm.run(code, { result: { pick: ["balance", "missing", "missing.deeper", "broken", "balance.toFixed.name.x"] } }), { balance: 1 })
+    await vm.dispose()
+})
+
+test("overlapping picks keep the outer value", async () => {
+    const vm = new Glomium()
+    assert.deepStrictEqual(await vm.run(ACCOUNT, { result: { pick: ["owner.name", "owner"] } }), { owner: { name: "a", tags: ["x", "y"] } })
+    assert.deepStrictEqual(await vm.run(ACCOUNT, { result: { pick: ["owner", "owner.name"] } }), { owner: { name: "a", tags: ["x", "y"] } })
+    // An array picked whole can't take a keyed child, the inner path is dropped
+    assert.deepStrictEqual(await vm.run(ACCOUNT, { result: { pick: ["owner.tags", "owner.tags.1"] } }), { owner: { tags: ["x", "y"] } })
+    // A primitive has no properties to read
+    assert.deepStrictEqual(await vm.run(ACCOUNT, { result: { pick: ["owner.name", "owner.name.length"] } }), { owner: { name: "a" } })
+    await vm.dispose()
+})
+
+test("discard resolves to null but keeps side effects", async () => {
+    const vm = new Glomium()
+    assert.strictEqual(await vm.run("var touched = true; " + ACCOUNT, { result: "discard" }), null)
+    assert.strictEqual(await vm.run("touched"), true)
+    await vm.dispose()
+})
+
+test("handle returns objects as handles and primitives as usual", async () => {
+    const vm = new Glomium()
+    const account = await vm.run(ACCOUNT, { result: "handle" })
+    assert.ok(account instanceof Glomium.GlomiumObjectHandle)
+    assert.strictEqual(await account.get("owner.tags.1"), "y")
+    assert.strictEqual(await vm.run("42", { result: "handle" }), 42)
+    await vm.dispose()
+})
+
+test("result modes are counted in the instance stats", async () => {
+    const vm = new Glomium()
+    await vm.run(ACCOUNT)
+    await vm.run(ACCOUNT, { result: "discard" })
+    await vm.run(ACCOUNT, { result: { pick: ["balance"] } })
+    await vm.run(ACCOUNT, { result: "handle" })
+    const { results } = vm.getStats()
+    assert.deepStrictEqual([results.converted, results.discarded, results.picked, results.handles], [1, 1, 1, 1])
+    assert.ok(results.bytes > 0)
+    await vm.dispose()
+})
+
+test("onStats reports execution, conversion and result size", async () => {
+    const vm = new Glomium()
+    let stats
+    const picked = await vm.run(ACCOUNT, { result: { pick: ["balance", "nonce"] }, onStats: s => { stats = s } })
+    assert.deepStrictEqual(picked, { balance: 10, nonce: 3 })
+    assert.deepStrictEqual(Object.keys(stats).sort(), ["conversionNs", "executionNs", "resultBytes"])
+    assert.ok(stats.executionNs >= 0 && stats.conversionNs >= 0)
+    assert.ok(stats.resultBytes >= JSON.stringify(picked).length)
+
+    let wholeStats, discardStats
+    await vm.run(ACCOUNT, { onStats: s => { wholeStats = s } })
+    await vm.run(ACCOUNT, { result: "discard", onStats: s => { discardStats = s } })
+    assert.ok(discardStats.resultBytes < stats.resultBytes && stats.resultBytes < wholeStats.resultBytes)
+
+    const script = await vm.compile("(function (a) { return { doubled: a * 2 } })")
+    let callStats
+    assert.deepStrictEqual(await script.call([4], { onStats: s => { callStats = s } }), { doubled: 8 })
+    assert.ok(callStats.resultBytes > 0)
+    await vm.dispose()
+})
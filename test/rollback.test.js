@@ -0,0 +1,84 @@
+// Checkpoint (clear({ soft: true })) and transaction rollback
+const test = require("node:test")
+const assert = require("node:assert")
+const Glomium = require("..")
+
+test("soft clear restores overwritten globals and drops added ones", async () => {
+    const vm = new Glomium()
+    await vm.run("var kept = 1; globalThis.loose = 'a'")
+    await vm.checkpoint()
+    await vm.run("kept = 2; delete globalThis.loose; var added = 3")
+    await vm.clear({ soft: true })
+    assert.deepStrictEqual(await vm.run("[kept, loose, typeof added]"), [1, "a", "undefined"])
+    await vm.dispose()
+})
+
+test("soft clear restores attributes without running guest accessors", async () => {
+    const vm = new Glomium()
+    let getterCalls = 0
+    await vm.set("hit", () => { getterCalls++ })
+    await vm.run("globalThis.loose = 1")
+    await vm.checkpoint()
+    await vm.run("Object.defineProperty(globalThis, 'loose', { get: function () { hit(); return 2 }, set: function () { hit() }, configurable: true })")
+    await vm.clear({ soft: true })
+    assert.strictEqual(getterCalls, 0)
+    assert.deepStrictEqual(await vm.run("Object.getOwnPropertyDescriptor(globalThis, 'loose')"), { value: 1, writable: true, enumerable: true, configurable: true })
+    assert.strictEqual(getterCalls, 0)
+    await vm.dispose()
+})
+
+test("soft clear falls back to a full clear when a builtin changed", async () => {
+    const vm = new Glomium()
+    await vm.run("var kept = 1")
+    await vm.checkpoint()
+    await vm.run("Array.prototype.extra = 1; ({}).constructor.prototype.other = 2")
+    await vm.clear({ soft: true })
+    assert.deepStrictEqual(await vm.run("[typeof kept, [].extra, ({}).other]"), ["undefined", undefined, undefined])
+    await vm.dispose()
+})
+
+test("soft clear falls back to a full clear when the global lost extensibility", async () => {
+    const vm = new Glomium()
+    await vm.run("var kept = 1")
+    await vm.checkpoint()
+    await vm.run("Object.preventExtensions(globalThis)")
+    await vm.clear({ soft: true })
+    assert.deepStrictEqual(await vm.run("var later = 2; [typeof kept, later]"), ["undefined", 2])
+    await vm.dispose()
+})
+
+test("a failed transaction undoes changes to globals and builtins", async () => {
+    const vm = new Glomium()
+    await vm.run("var state = { count: 1 }")
+    await assert.rejects(vm.run("state.count = 2; state.added = true; var leaked = 1; Array.prototype.extra = 1; throw new Error('abort')", { transaction: true }), /abort/)
+    assert.deepStrictEqual(await vm.run("[state, typeof leaked, [].extra]"), [{ count: 1 }, "undefined", undefined])
+    await vm.dispose()
+})
+
+test("a successful transaction keeps its changes", async () => {
+    const vm = new Glomium()
+    await vm.run("var state = { count: 1 }")
+    await vm.run("state.count = 2", { transaction: true })
+    assert.deepStrictEqual(await vm.run("state"), { count: 2 })
+    await vm.dispose()
+})
+
+test("transactions work when the profile hides the builtins", async () => {
+    const vm = new Glomium({ profile: "bare" })
+    await assert.rejects(vm.run("[].constructor.prototype.extra = 1; throw 1", { transaction: true }))
+    assert.strictEqual(await vm.run("[].extra"), undefined)
+    await vm.dispose()
+})
+
+test("a transaction that runs out of gas is rolled back and keeps the heap", async () => {
+    const vm = new Glomium({ gas: { limit: 2000000, memoryByteCost: 0 } })
+    await vm.run("var state = { count: 1 }")
+    await assert.rejects(vm.run("state.count = 2; var leaked = 1; while (true) { try { for (;;) {} } catch (e) {} }", { transaction: true }), error => {
+        assert.strictEqual(error.message, "Out of gas")
+        assert.ok(error.gasInfo.gasUsed > error.gasInfo.gasLimit)
+        return true
+    })
+    await vm.setGas({ limit: 2000000, memoryByteCost: 0 })
+    assert.deepStrictEqual(await vm.run("[state, typeof leaked]"), [{ count: 1 }, "undefined"])
+    await vm.dispose()
+})
@@ -0,0 +1,62 @@
+// Compiled script cache: hit and miss counting, LRU eviction under maxBytes, retained template scripts never evicted
+const test = require("node:test")
+const assert = require("node:assert")
+const Glomium = require("..")
+
+function cacheStats() {
+    return Glomium.getStats().scriptCache
+}
+
+function script(name) {
+    return `var ${name} = []; for (var i = 0; i < 20; i++) ${name}.push("${name}" + i); ${name}.length`
+}
+
+test("hits and misses are counted per run()", async () => {
+    Glomium.configurePool({ scriptCache: { maxBytes: 1 << 20 } })
+    const vm = new Glomium()
+    const before = cacheStats()
+    await vm.run(script("counted"))
+    await vm.run(script("counted"))
+    await vm.run(script("counted"))
+    const after = cacheStats()
+    assert.strictEqual(after.misses - before.misses, 1)
+    assert.strictEqual(after.hits - before.hits, 2)
+    await vm.dispose()
+})
+
+test("trimming evicts least recently used scripts and keeps retained ones", async () => {
+    Glomium.configurePool({ scriptCache: { maxBytes: 1 << 20 } })
+    const template = await Glomium.createTemplate({}, async t => {
+        await t.run("var fromTemplate = 'kept'")
+    })
+    const vm = new Glomium()
+    for (const name of ["first", "second", "third"]) {
+        assert.strictEqual(await vm.run(script(name)), 20)
+    }
+    const filled = cacheStats()
+
+    // One byte short: only the least recently used unretained script has to go
+    Glomium.configurePool({ scriptCache: { maxBytes: filled.bytes - 1 } })
+    const trimmed = cacheStats()
+    assert.strictEqual(trimmed.evictions - filled.evictions, 1)
+    assert.strictEqual(trimmed.entries, filled.entries - 1)
+
+    // Nothing unretained fits anymore, the template's script stays
+    Glomium.configurePool({ scriptCache: { maxBytes: 1 } })
+    const emptied = cacheStats()
+    assert.strictEqual(emptied.evictions - filled.evictions, 3)
+    assert.strictEqual(emptied.entries, filled.entries - 3)
+    assert.ok(emptied.entries >= 1)
+
+    const fromTemplate = new Glomium({ template })
+    assert.strictEqual(await fromTemplate.run("fromTemplate"), "kept")
+
+    // An evicted script compiles again on its next run
+    Glomium.configurePool({ scriptCache: { maxBytes: 1 << 20 } })
+    const beforeRerun = cacheStats()
+    assert.strictEqual(await vm.run(script("first")), 20)
+    assert.strictEqual(cacheStats().misses - beforeRerun.misses, 1)
+
+    await fromTemplate.dispose()
+    await vm.dispose()
+})